@@ -0,0 +1,283 @@
+#include "AnnotatedTree.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+#include "ErrorMeasurement.hpp"
+#include "Utils.hpp"
+
+namespace {
+    const char* const METHODS[] = {"VAR", "MAD", "MPD", "ENT", "SSIM"};
+
+    const uint32_t FILE_MAGIC = 0x41525451;  // "QTRA" in little-endian byte order
+    const uint32_t FILE_VERSION = 1;
+
+    // Start of a saved tree; the blocks follow, then one error column per bit of methodMask
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint64_t imageHash;
+        uint32_t blockCount;
+        uint32_t methodMask;
+    };
+
+    // Saved block: first child index, average color and whether it has been computed
+    const size_t BLOCK_BYTES = sizeof(uint32_t) + 4;
+
+    const double UNKNOWN = std::numeric_limits<double>::quiet_NaN();
+}
+
+AnnotatedTree::AnnotatedTree(int width, int height, uint64_t imageHash)
+    : width(width), height(height), imageHash(imageHash), blocks(1), reused(0), computed(0), modified(false) {
+}
+
+bool AnnotatedTree::matches(int width, int height, uint64_t imageHash) const {
+    return this->width == width && this->height == height && this->imageHash == imageHash;
+}
+
+uint64_t AnnotatedTree::getImageHash() const {
+    return imageHash;
+}
+
+int AnnotatedTree::methodIndex(const std::string& errorMethod) {
+    for (int i = 0; i < METHOD_COUNT; ++i) {
+        if (errorMethod == METHODS[i]) return i;
+    }
+    throw std::invalid_argument("Unsupported error calculation method: " + errorMethod);
+}
+
+void AnnotatedTree::build(QuadTree& tree, const std::vector<std::vector<RGB>>& image, const std::string& errorMethod,
+                          double threshold, int minBlockSize, const QuadTree::LevelCallback& onLevelComplete) {
+    std::vector<double>& methodErrors = errors[methodIndex(errorMethod)];
+    methodErrors.resize(blocks.size(), UNKNOWN);
+
+    tree.clear();
+    tree.resetBuildStats();
+    reused = computed = 0;
+    if (!tree.getRoot()) return;
+
+    // Same order as QuadTree::buildLevels, with each tree node paired with its block
+    std::vector<std::pair<QuadTreeNode*, uint32_t>> level(1, std::make_pair(tree.getRoot(), 0u)), next;
+    std::vector<QuadTreeNode*> levelNodes;
+    for (int depth = 0; !level.empty(); ++depth) {
+        next.clear();
+        for (const auto& entry : level) {
+            QuadTreeNode* node = entry.first;
+            uint32_t index = entry.second;
+            int x = node->getPosX();
+            int y = node->getPosY();
+            int blockWidth = node->getBlockWidth();
+            int blockHeight = node->getBlockHeight();
+
+            long long scanned = 0;
+            double error = evaluate(index, image, x, y, blockWidth, blockHeight, errorMethod, methodErrors, scanned);
+            node->setAverageColor(blocks[index].average);
+            node->setError(error);
+            bool split = shouldSplit(error, threshold, blockWidth, blockHeight, minBlockSize);
+
+            ++tree.nodesEvaluated;
+            tree.pixelsScanned += scanned;
+            tree.recordNode(depth, error, split, threshold).pixelsScanned += scanned;
+
+            if (!split) continue;
+            uint32_t firstChild = allocateChildren(index);
+            node->subdivide();
+            for (int i = 0; i < 4; ++i) {
+                next.push_back(std::make_pair(node->getChildAt(i), firstChild + i));
+            }
+        }
+
+        if (onLevelComplete) {
+            levelNodes.clear();
+            for (const auto& entry : level) {
+                levelNodes.push_back(entry.first);
+            }
+            onLevelComplete(depth, levelNodes);
+        }
+        level.swap(next);
+    }
+}
+
+long long AnnotatedTree::countLeaves(const std::vector<std::vector<RGB>>& image, const std::string& errorMethod,
+                                     double threshold, int minBlockSize) {
+    std::vector<double>& methodErrors = errors[methodIndex(errorMethod)];
+    methodErrors.resize(blocks.size(), UNKNOWN);
+    reused = computed = 0;
+    if (image.empty() || image[0].empty()) return 0;
+
+    struct Pending {
+        uint32_t index;
+        int x, y, width, height;
+    };
+    std::vector<Pending> stack(1, Pending{0, 0, 0, width, height});
+    long long leaves = 0;
+    while (!stack.empty()) {
+        Pending block = stack.back();
+        stack.pop_back();
+
+        long long scanned = 0;
+        double error = evaluate(block.index, image, block.x, block.y, block.width, block.height, errorMethod,
+                                methodErrors, scanned);
+        if (!shouldSplit(error, threshold, block.width, block.height, minBlockSize)) {
+            ++leaves;
+            continue;
+        }
+
+        // Same layout as QuadTreeNode::subdivide
+        uint32_t firstChild = allocateChildren(block.index);
+        int halfWidth = block.width / 2;
+        int halfHeight = block.height / 2;
+        int remWidth = block.width - halfWidth;
+        int remHeight = block.height - halfHeight;
+        stack.push_back(Pending{firstChild, block.x, block.y, halfWidth, halfHeight});
+        stack.push_back(Pending{firstChild + 1, block.x + halfWidth, block.y, remWidth, halfHeight});
+        stack.push_back(Pending{firstChild + 2, block.x, block.y + halfHeight, halfWidth, remHeight});
+        stack.push_back(Pending{firstChild + 3, block.x + halfWidth, block.y + halfHeight, remWidth, remHeight});
+    }
+    return leaves;
+}
+
+double AnnotatedTree::evaluate(uint32_t index, const std::vector<std::vector<RGB>>& image, int x, int y,
+                               int blockWidth, int blockHeight, const std::string& errorMethod,
+                               std::vector<double>& methodErrors, long long& scanned) {
+    Block& block = blocks[index];
+    if (!block.hasAverage) {
+        block.average = ErrorMeasurement::calculateAverageColor(image, x, y, blockWidth, blockHeight);
+        block.hasAverage = true;
+        scanned += 1LL * blockWidth * blockHeight;
+    }
+    if (std::isnan(methodErrors[index])) {
+        methodErrors[index] = ErrorMeasurement::calculateError(image, x, y, blockWidth, blockHeight,
+                                                               block.average, errorMethod);
+        scanned += 1LL * blockWidth * blockHeight;
+        ++computed;
+        modified = true;
+    } else {
+        ++reused;
+    }
+    return methodErrors[index];
+}
+
+bool AnnotatedTree::shouldSplit(double error, double threshold, int blockWidth, int blockHeight, int minBlockSize) {
+    // Same rule as QuadTree::evaluateNode
+    return error > threshold &&
+        blockWidth >= minBlockSize &&
+        blockHeight >= minBlockSize &&
+        blockWidth / 2 >= minBlockSize &&
+        blockHeight / 2 >= minBlockSize;
+}
+
+uint32_t AnnotatedTree::allocateChildren(uint32_t index) {
+    if (blocks[index].firstChild == 0) {
+        blocks[index].firstChild = static_cast<uint32_t>(blocks.size());
+        blocks.resize(blocks.size() + 4);
+        for (std::vector<double>& column : errors) {
+            if (!column.empty()) column.resize(blocks.size(), UNKNOWN);
+        }
+    }
+    return blocks[index].firstChild;
+}
+
+long long AnnotatedTree::getReusedCount() const {
+    return reused;
+}
+
+long long AnnotatedTree::getComputedCount() const {
+    return computed;
+}
+
+bool AnnotatedTree::isModified() const {
+    return modified;
+}
+
+long long AnnotatedTree::blockBytes(int methods) {
+    return static_cast<long long>(sizeof(Block) + methods * sizeof(double));
+}
+
+bool AnnotatedTree::save(const std::string& filename) {
+    FileHeader header = {FILE_MAGIC, FILE_VERSION, static_cast<uint32_t>(width), static_cast<uint32_t>(height),
+                         imageHash, static_cast<uint32_t>(blocks.size()), 0};
+    for (int i = 0; i < METHOD_COUNT; ++i) {
+        if (!errors[i].empty()) header.methodMask |= 1u << i;
+    }
+
+    // Written under a temporary name so a reader never sees a partial file
+    std::string temporaryFile = Utils::temporaryPath(filename);
+    {
+        std::ofstream out(temporaryFile, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        std::vector<char> data(blocks.size() * BLOCK_BYTES);
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            char* bytes = &data[i * BLOCK_BYTES];
+            std::memcpy(bytes, &blocks[i].firstChild, sizeof(uint32_t));
+            bytes[4] = static_cast<char>(blocks[i].average.r);
+            bytes[5] = static_cast<char>(blocks[i].average.g);
+            bytes[6] = static_cast<char>(blocks[i].average.b);
+            bytes[7] = blocks[i].hasAverage ? 1 : 0;
+        }
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        for (const std::vector<double>& column : errors) {
+            if (!column.empty()) {
+                out.write(reinterpret_cast<const char*>(column.data()),
+                          static_cast<std::streamsize>(column.size() * sizeof(double)));
+            }
+        }
+        if (!out.good()) {
+            out.close();
+            std::remove(temporaryFile.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporaryFile.c_str(), filename.c_str()) != 0) {
+        std::remove(temporaryFile.c_str());
+        return false;
+    }
+    modified = false;
+    return true;
+}
+
+std::unique_ptr<AnnotatedTree> AnnotatedTree::load(const std::string& filename, int width, int height,
+                                                   uint64_t imageHash) {
+    std::ifstream in(filename, std::ios::binary);
+    FileHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != FILE_MAGIC ||
+        header.version != FILE_VERSION || header.width != static_cast<uint32_t>(width) ||
+        header.height != static_cast<uint32_t>(height) || header.imageHash != imageHash ||
+        header.blockCount == 0 || header.methodMask >> METHOD_COUNT != 0) {
+        return nullptr;
+    }
+
+    std::unique_ptr<AnnotatedTree> annotations(new AnnotatedTree(width, height, imageHash));
+    std::vector<char> data(static_cast<size_t>(header.blockCount) * BLOCK_BYTES);
+    if (!in.read(data.data(), static_cast<std::streamsize>(data.size()))) return nullptr;
+
+    annotations->blocks.resize(header.blockCount);
+    for (uint32_t i = 0; i < header.blockCount; ++i) {
+        const char* bytes = &data[static_cast<size_t>(i) * BLOCK_BYTES];
+        Block& block = annotations->blocks[i];
+        std::memcpy(&block.firstChild, bytes, sizeof(uint32_t));
+        block.average = {static_cast<uint8_t>(bytes[4]), static_cast<uint8_t>(bytes[5]), static_cast<uint8_t>(bytes[6])};
+        block.hasAverage = bytes[7] == 1;
+        // Children always come after their parent, so a build can never loop
+        if (block.firstChild != 0 && (block.firstChild <= i || static_cast<uint64_t>(block.firstChild) + 4 > header.blockCount)) {
+            return nullptr;
+        }
+    }
+
+    for (int m = 0; m < METHOD_COUNT; ++m) {
+        if (!(header.methodMask & (1u << m))) continue;
+        std::vector<double>& column = annotations->errors[m];
+        column.resize(header.blockCount);
+        if (!in.read(reinterpret_cast<char*>(column.data()),
+                     static_cast<std::streamsize>(column.size() * sizeof(double)))) {
+            return nullptr;
+        }
+    }
+    return annotations;
+}
@@ -0,0 +1,400 @@
+#include "Batch.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <streambuf>
+
+#include "ImageProcessor.hpp"
+#include "QuadTreeCompressor.hpp"
+#include "Stats.hpp"
+#include "Trace.hpp"
+#include "Metrics.hpp"
+#include "ResultCache.hpp"
+#include "AnnotatedTree.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+    struct BuildCost {
+        const char* method;
+        double nsPerPixel;
+    };
+
+    // Whole-build time per pixel and tree level, measured on the test images at mid-range
+    // thresholds; the real depth depends on the threshold, so this is an estimate for ordering
+    const BuildCost BUILD_COSTS[] = {
+        {"VAR", 120.0}, {"MAD", 35.0}, {"MPD", 40.0}, {"ENT", 60.0}, {"SSIM", 90.0}
+    };
+
+    // Allocator bookkeeping on top of each node
+    const long long NODE_OVERHEAD_BYTES = 16;
+    const long long MEGABYTE = 1024 * 1024;
+    // Used when the physical memory size is unknown
+    const long long DEFAULT_BUDGET_MB = 4096;
+
+    long long physicalMemoryBytes() {
+#ifdef _WIN32
+        MEMORYSTATUSEX status;
+        status.dwLength = sizeof(status);
+        return GlobalMemoryStatusEx(&status) ? static_cast<long long>(status.ullTotalPhys) : 0;
+#else
+        long pages = sysconf(_SC_PHYS_PAGES);
+        long pageSize = sysconf(_SC_PAGESIZE);
+        return pages > 0 && pageSize > 0 ? static_cast<long long>(pages) * pageSize : 0;
+#endif
+    }
+
+    // Accepts and drops everything, so streams writing to it stay good. Workers write to std::cout
+    // concurrently; a null buffer would instead set its error state from every thread.
+    class DiscardBuffer : public std::streambuf {
+    protected:
+        std::streamsize xsputn(const char*, std::streamsize size) override {
+            return size;
+        }
+
+        int_type overflow(int_type c) override {
+            return traits_type::not_eof(c);
+        }
+    };
+
+    // One path per line; blank lines and lines starting with '#' are skipped
+    bool readList(const std::string& listFile, std::vector<std::string>& inputs) {
+        std::ifstream file;
+        if (listFile != "-") {
+            file.open(listFile);
+            if (!file.is_open()) return false;
+        }
+        std::istream& list = listFile == "-" ? std::cin : file;
+
+        std::string line;
+        while (std::getline(list, line)) {
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            line.erase(0, line.find_first_not_of(" \t"));
+            if (!line.empty() && line[0] != '#') {
+                inputs.push_back(Utils::normalizePath(line));
+            }
+        }
+        return true;
+    }
+
+    // Same naming as the single-image default, optionally moved into outputDir
+    std::string outputPathFor(const std::string& input, const std::string& outputDir) {
+        std::string ext = Utils::getFileExtension(input);
+        std::string base = ext.empty() ? input : input.substr(0, input.length() - ext.length() - 1);
+        std::string output = base + "_compressed." + (ext.empty() ? "png" : ext);
+        if (!outputDir.empty()) {
+            output = outputDir + "/" + Utils::getFileNameFromPath(output);
+        }
+        return output;
+    }
+
+    long long fileSize(const std::string& filename) {
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        return file.is_open() ? static_cast<long long>(file.tellg()) : 0;
+    }
+
+    // Hands out jobs largest-first; a job starts only while the estimates of the running
+    // jobs plus its own fit the budget, except that a job over the whole budget may run alone
+    class Scheduler {
+    public:
+        Scheduler(const std::vector<const Batch::Job*>& jobs, long long budget)
+            : pending(jobs), budget(budget), reserved(0), running(0) {}
+
+        // Blocks until a job fits; null once every job has been handed out
+        const Batch::Job* acquire() {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;) {
+                if (pending.empty()) return nullptr;
+                for (size_t i = 0; i < pending.size(); ++i) {
+                    const Batch::Job* job = pending[i];
+                    if (running == 0 || reserved + job->estimatedBytes <= budget) {
+                        pending.erase(pending.begin() + i);
+                        reserved += job->estimatedBytes;
+                        ++running;
+                        return job;
+                    }
+                }
+                released.wait(lock);
+            }
+        }
+
+        void release(const Batch::Job& job) {
+            std::lock_guard<std::mutex> lock(mutex);
+            reserved -= job.estimatedBytes;
+            --running;
+            released.notify_all();
+        }
+
+    private:
+        std::vector<const Batch::Job*> pending;
+        long long budget;
+        long long reserved;
+        int running;
+        std::mutex mutex;
+        std::condition_variable released;
+    };
+
+    bool compressOne(const Batch::Job& job, const Utils::ProgramOptions& options, double baseThreshold,
+                     const ResultCache& cache, bool& cacheHit, std::string& error) {
+        std::vector<std::vector<RGB>> image;
+        try {
+            Stats::ScopedPhase phase("decode");
+            image = ImageProcessor::loadImage(job.inputFile);
+        } catch (const std::exception& e) {
+            Metrics::recordError("decode");
+            error = e.what();
+            return false;
+        }
+
+        std::string cacheKey;
+        QuadTree tree(static_cast<int>(image[0].size()), static_cast<int>(image.size()));
+        double threshold = baseThreshold;
+        if (cache.enabled()) {
+            Stats::ScopedPhase phase("cache_lookup");
+            cacheKey = ResultCache::makeKey(image, options.errorMethod, baseThreshold, options.minBlockSize,
+                                            options.targetCompressionRatio);
+            cacheHit = cache.loadTree(cacheKey, tree, threshold);
+        }
+
+        QuadTreeCompressor compressor;
+        if (options.annotate) {
+            compressor.enableAnnotations(options.annotationDir);
+        }
+
+        // Target-ratio runs change the static threshold, so they only happen with one job at a time
+        if (!cacheHit && options.targetCompressionRatio > 0) {
+            Stats::ScopedPhase phase("target_ratio_search");
+            Utils::ProgramOptions::threshold = baseThreshold;
+            threshold = compressor.adjustThresholdForTargetRatio(
+                image, options.targetCompressionRatio, baseThreshold, options.errorMethod, options.minBlockSize);
+            Utils::ProgramOptions::threshold = threshold;
+        }
+
+        double buildSeconds = 0;
+        if (!cacheHit) {
+            auto buildStart = std::chrono::steady_clock::now();
+            Stats::ScopedPhase buildPhase("build");
+            tree = compressor.compressImage(image, threshold, options.errorMethod);
+            buildPhase.stop();
+            buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count();
+            cache.storeTree(cacheKey, tree, threshold);
+        }
+
+        // The pixels are not needed for encoding
+        std::vector<std::vector<RGB>>().swap(image);
+
+        if (!(cacheHit && cache.loadOutput(cacheKey, job.outputFile, options.quantizePalette))) {
+            if (!ImageProcessor::saveImage(tree, job.outputFile, options.quantizePalette)) {
+                Metrics::recordError("save");
+                error = "failed to save " + job.outputFile;
+                return false;
+            }
+            cache.storeOutput(cacheKey, job.outputFile, options.quantizePalette);
+        }
+
+        Metrics::recordImage(options.errorMethod, fileSize(job.inputFile), fileSize(job.outputFile), buildSeconds);
+        return true;
+    }
+}
+
+namespace Batch {
+    long long estimateBytes(int width, int height, int channels, int minBlockSize, bool annotated) {
+        long long pixels = static_cast<long long>(width) * height;
+        long long block = std::max(1, minBlockSize);
+        // A complete tree has 4/3 as many nodes as leaves, and there is at most one leaf per block
+        long long leaves = (pixels + block * block - 1) / (block * block);
+        long long treeBytes = leaves * 4 / 3 * (static_cast<long long>(sizeof(QuadTreeNode)) + NODE_OVERHEAD_BYTES);
+        // Batch jobs use one error method
+        if (annotated) treeBytes += leaves * 4 / 3 * AnnotatedTree::blockBytes(1);
+        // While decoding, stb_image's buffer and the RGB rows exist together
+        long long decodeBytes = pixels * (3 + std::max(1, channels));
+        return std::max(decodeBytes, pixels * 3 + treeBytes);
+    }
+
+    double estimateSeconds(int width, int height, const std::string& errorMethod, int minBlockSize) {
+        double nsPerPixel = BUILD_COSTS[0].nsPerPixel;
+        for (const BuildCost& cost : BUILD_COSTS) {
+            if (errorMethod == cost.method) nsPerPixel = cost.nsPerPixel;
+        }
+        // Every level of a full tree covers the whole image
+        double pixels = static_cast<double>(width) * height;
+        double block = std::max(1, minBlockSize);
+        double levels = 1 + std::max(0.0, std::floor(std::log(pixels / (block * block)) / std::log(4.0)));
+        return pixels * levels * nsPerPixel * 1e-9;
+    }
+
+    int run(Utils::ProgramOptions& options) {
+        std::vector<std::string> inputs;
+        if (!readList(options.batchFile, inputs)) {
+            std::cerr << "Error: Cannot read batch list: " << options.batchFile << "\n";
+            return 1;
+        }
+        if (inputs.empty()) {
+            std::cerr << "Error: Batch list is empty: " << options.batchFile << "\n";
+            return 1;
+        }
+
+        if (!options.traceFile.empty()) {
+            Trace::enable();
+            Trace::setThreadName("main");
+        }
+        auto startTime = std::chrono::steady_clock::now();
+
+        // Probe every input before anything is decoded
+        std::vector<Job> jobs(inputs.size());
+        std::vector<const Job*> runnable;
+        int failed = 0;
+        {
+            Stats::ScopedPhase phase("probe");
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                Job& job = jobs[i];
+                job.inputFile = inputs[i];
+                job.outputFile = outputPathFor(inputs[i], options.outputDir);
+                if (!Utils::fileExists(job.inputFile) ||
+                    !ImageProcessor::probeImage(job.inputFile, job.width, job.height, job.channels)) {
+                    std::cerr << "Error: Cannot read image header: " << job.inputFile << "\n";
+                    Metrics::recordError("decode");
+                    ++failed;
+                    continue;
+                }
+                job.estimatedBytes = estimateBytes(job.width, job.height, job.channels, options.minBlockSize,
+                                                   options.annotate || options.targetCompressionRatio > 0);
+                job.estimatedSeconds = estimateSeconds(job.width, job.height, options.errorMethod, options.minBlockSize);
+                runnable.push_back(&job);
+            }
+        }
+        std::stable_sort(runnable.begin(), runnable.end(), [](const Job* a, const Job* b) {
+            return a->estimatedSeconds > b->estimatedSeconds;
+        });
+
+        long long budget = options.memoryBudgetMB > 0 ? options.memoryBudgetMB * MEGABYTE : physicalMemoryBytes() / 2;
+        if (budget <= 0) budget = DEFAULT_BUDGET_MB * MEGABYTE;
+
+        unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+        int jobCount = options.jobs > 0 ? options.jobs : static_cast<int>(hardwareThreads);
+        if (options.targetCompressionRatio > 0) jobCount = 1;
+        jobCount = std::max(1, std::min(jobCount, static_cast<int>(runnable.size())));
+
+        // Concurrent jobs share the cores instead of each starting a full set of render and encode threads
+        if (Utils::ProgramOptions::threads == 0 && jobCount > 1) {
+            Utils::ProgramOptions::threads = std::max(1, static_cast<int>(hardwareThreads) / jobCount);
+        }
+
+        double totalSeconds = 0;
+        long long largestBytes = 0;
+        for (const Job* job : runnable) {
+            totalSeconds += job->estimatedSeconds;
+            largestBytes = std::max(largestBytes, job->estimatedBytes);
+        }
+        std::cout << "Batch: " << inputs.size() << " images, " << jobCount << " jobs, memory budget "
+                  << budget / MEGABYTE << " MB\n";
+        std::cout << "Estimated build time " << std::fixed << std::setprecision(1) << totalSeconds
+                  << " s single-threaded, largest image " << largestBytes / MEGABYTE << " MB\n";
+        if (options.verbose) {
+            std::cout << "\nPlanned order:\n";
+            for (const Job* job : runnable) {
+                std::cout << "  " << std::setw(6) << job->width << "x" << std::left << std::setw(6) << job->height
+                          << std::right << std::setw(8) << job->estimatedBytes / MEGABYTE << " MB"
+                          << std::setw(8) << std::setprecision(2) << job->estimatedSeconds << " s  "
+                          << job->inputFile << "\n";
+            }
+        }
+        std::cout << std::endl;
+
+        // The per-image messages of the loader and encoders would interleave; only the batch
+        // progress lines are printed unless --verbose is given
+        std::streambuf* consoleBuffer = std::cout.rdbuf();
+        std::ostream progress(consoleBuffer);
+        DiscardBuffer discard;
+        if (!options.verbose) std::cout.rdbuf(&discard);
+
+        ResultCache cache(options.cacheDir, options.cacheSizeMB * MEGABYTE);
+        Scheduler scheduler(runnable, budget);
+        std::mutex progressMutex;
+        size_t finished = static_cast<size_t>(failed);
+        double baseThreshold = Utils::ProgramOptions::threshold;
+
+        auto worker = [&]() {
+            while (const Job* job = scheduler.acquire()) {
+                auto jobStart = std::chrono::steady_clock::now();
+                std::string error;
+                bool ok = false;
+                bool cacheHit = false;
+                try {
+                    ok = compressOne(*job, options, baseThreshold, cache, cacheHit, error);
+                } catch (const std::exception& e) {
+                    Metrics::recordError("exception");
+                    error = e.what();
+                }
+                scheduler.release(*job);
+
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - jobStart).count();
+                std::lock_guard<std::mutex> lock(progressMutex);
+                ++finished;
+                progress << "[" << finished << "/" << inputs.size() << "] ";
+                if (ok) {
+                    progress << job->inputFile << " -> " << job->outputFile << " (" << job->width << "x"
+                             << job->height << ", " << static_cast<long long>(ms) << " ms" << (cacheHit ? ", cached" : "")
+                             << ")" << std::endl;
+                } else {
+                    ++failed;
+                    progress << "FAILED " << job->inputFile << ": " << error << std::endl;
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (int t = 1; t < jobCount; ++t) {
+            workers.emplace_back([&worker, t]() {
+                Trace::setThreadName("batch job " + std::to_string(t));
+                worker();
+            });
+        }
+        worker();
+        for (auto& thread : workers) {
+            thread.join();
+        }
+        std::cout.rdbuf(consoleBuffer);
+
+        double totalWallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        std::cout << "\nBatch finished: " << inputs.size() - failed << " compressed, " << failed << " failed in "
+                  << std::fixed << std::setprecision(2) << totalWallMs / 1000.0 << " s; peak RSS "
+                  << Stats::peakResidentKB() / 1024 << " MB\n";
+
+        if (!options.statsFile.empty()) {
+            Stats::addCounter("batch_images", static_cast<long long>(inputs.size()));
+            Stats::addCounter("batch_failed", failed);
+            Stats::addCounter("batch_jobs", jobCount);
+            Stats::addCounter("batch_memory_budget_bytes", budget);
+            std::vector<std::pair<std::string, std::string>> info = {
+                {"batch", options.batchFile},
+                {"error_method", options.errorMethod},
+                {"threshold", std::to_string(baseThreshold)},
+                {"min_block", std::to_string(options.minBlockSize)}
+            };
+            if (!Stats::writeJson(options.statsFile, info, totalWallMs)) {
+                std::cerr << "Error: Failed to write statistics to: " << options.statsFile << "\n";
+            }
+        }
+        if (!options.metricsFile.empty() && !Metrics::mergeIntoTextfile(options.metricsFile)) {
+            std::cerr << "Error: Failed to write metrics to: " << options.metricsFile << "\n";
+        }
+        if (!options.traceFile.empty() && !Trace::writeJson(options.traceFile)) {
+            std::cerr << "Error: Failed to write trace to: " << options.traceFile << "\n";
+        }
+
+        return failed > 0 ? 1 : 0;
+    }
+}
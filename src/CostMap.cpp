@@ -0,0 +1,57 @@
+#include "CostMap.hpp"
+#include "ImageProcessor.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    const RGB HEAT_STOPS[] = {
+        {0, 0, 4}, {87, 16, 110}, {188, 55, 84}, {249, 142, 9}, {252, 255, 164}
+    };
+    const int HEAT_STOP_COUNT = sizeof(HEAT_STOPS) / sizeof(HEAT_STOPS[0]);
+
+    // Error ratios from 1/8x to 8x of the threshold span the error map
+    const double ERROR_RATIO_LOG2_RANGE = 3.0;
+
+    std::string errorMapPath(const std::string& filename) {
+        std::string ext = Utils::getFileExtension(filename);
+        if (ext.empty()) return filename + "_error";
+        return filename.substr(0, filename.length() - ext.length() - 1) + "_error." + ext;
+    }
+}
+
+namespace CostMap {
+    RGB heatColor(double t) {
+        if (!(t > 0)) return HEAT_STOPS[0];
+        if (t >= 1) return HEAT_STOPS[HEAT_STOP_COUNT - 1];
+
+        double position = t * (HEAT_STOP_COUNT - 1);
+        int index = static_cast<int>(position);
+        double f = position - index;
+        const RGB& a = HEAT_STOPS[index];
+        const RGB& b = HEAT_STOPS[index + 1];
+        return {static_cast<uint8_t>(a.r + (b.r - a.r) * f + 0.5),
+                static_cast<uint8_t>(a.g + (b.g - a.g) * f + 0.5),
+                static_cast<uint8_t>(a.b + (b.b - a.b) * f + 0.5)};
+    }
+
+    bool save(const QuadTree& tree, double threshold, const std::string& filename) {
+        int maxDepth = std::max(0, tree.getDepth());
+        std::vector<std::vector<RGB>> image;
+
+        // Scans per pixel grow linearly with depth, from 2 at the root to 2 * (maxDepth + 1)
+        tree.saveToImage(image, [maxDepth](const QuadTreeNode&, int depth) {
+            return heatColor(maxDepth > 0 ? static_cast<double>(depth) / maxDepth : 1.0);
+        });
+        if (!ImageProcessor::saveImage(image, filename)) return false;
+
+        tree.saveToImage(image, [threshold](const QuadTreeNode& leaf, int) {
+            double error = leaf.getError();
+            if (error <= 0) return heatColor(0);
+            if (threshold <= 0) return heatColor(1);
+            double log2Ratio = std::log2(error / threshold);
+            return heatColor((log2Ratio + ERROR_RATIO_LOG2_RANGE) / (2 * ERROR_RATIO_LOG2_RANGE));
+        });
+        return ImageProcessor::saveImage(image, errorMapPath(filename));
+    }
+}
@@ -0,0 +1,460 @@
+#include "Deflate.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <thread>
+
+namespace {
+    const int WINDOW_SIZE = 32768;
+    const int WINDOW_MASK = WINDOW_SIZE - 1;
+    const int HASH_BITS = 15;
+    const int HASH_SIZE = 1 << HASH_BITS;
+    const int MIN_MATCH = 3;
+    const int MAX_MATCH = 258;
+    const int END_OF_BLOCK = 256;
+
+    // Input is compressed in chunks once this much lookahead is buffered
+    const size_t CHUNK_SIZE = 64 * 1024;
+
+    // Input block handed to each worker by ParallelDeflate
+    const size_t PARALLEL_BLOCK_SIZE = 128 * 1024;
+
+    // Hash chain depth searched for each compression level
+    const int MAX_CHAIN[10] = {0, 4, 8, 16, 32, 64, 128, 256, 1024, 4096};
+
+    const uint16_t LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                      35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                      3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    const uint16_t DIST_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                    8193, 12289, 16385, 24577};
+    const uint8_t DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    uint32_t reverseBits(uint32_t code, int length) {
+        uint32_t result = 0;
+        for (int i = 0; i < length; ++i) {
+            result = (result << 1) | (code & 1);
+            code >>= 1;
+        }
+        return result;
+    }
+
+    // Precomputed fixed Huffman codes (already bit-reversed) and symbol lookups
+    struct FixedTables {
+        uint16_t literalCode[288];
+        uint8_t literalLength[288];
+        uint8_t lengthSymbol[MAX_MATCH + 1];
+        uint8_t distSymbolLow[256];   // distances 1..256
+        uint8_t distSymbolHigh[256];  // distances 257..32768, indexed by (distance - 1) >> 7
+        uint32_t crcTable[256];
+
+        FixedTables() {
+            for (int n = 0; n < 288; ++n) {
+                uint32_t code;
+                int length;
+                if (n <= 143) { code = 0x30 + n; length = 8; }
+                else if (n <= 255) { code = 0x190 + (n - 144); length = 9; }
+                else if (n <= 279) { code = n - 256; length = 7; }
+                else { code = 0xC0 + (n - 280); length = 8; }
+                literalCode[n] = static_cast<uint16_t>(reverseBits(code, length));
+                literalLength[n] = static_cast<uint8_t>(length);
+            }
+
+            int symbol = 0;
+            for (int length = MIN_MATCH; length <= MAX_MATCH; ++length) {
+                while (symbol < 28 && LENGTH_BASE[symbol + 1] <= length) ++symbol;
+                lengthSymbol[length] = static_cast<uint8_t>(symbol);
+            }
+
+            symbol = 0;
+            for (int distance = 1; distance <= 256; ++distance) {
+                while (symbol < 29 && DIST_BASE[symbol + 1] <= distance) ++symbol;
+                distSymbolLow[distance - 1] = static_cast<uint8_t>(symbol);
+            }
+            for (int i = 2; i < 256; ++i) {
+                int distance = (i << 7) + 1;
+                while (symbol < 29 && DIST_BASE[symbol + 1] <= distance) ++symbol;
+                distSymbolHigh[i] = static_cast<uint8_t>(symbol);
+            }
+            distSymbolHigh[0] = distSymbolHigh[1] = 0;
+
+            for (uint32_t n = 0; n < 256; ++n) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                crcTable[n] = c;
+            }
+        }
+    };
+
+    const FixedTables& tables() {
+        static const FixedTables instance;
+        return instance;
+    }
+
+    inline uint32_t hash3(const uint8_t* p) {
+        uint32_t value = p[0] | (p[1] << 8) | (p[2] << 16);
+        return (value * 2654435761u) >> (32 - HASH_BITS);
+    }
+}
+
+DeflateStream::DeflateStream(int level, bool zlibWrapper)
+    : zlibWrapper(zlibWrapper), bufferStart(0), position(0),
+      head(HASH_SIZE, -1), prev(WINDOW_SIZE, -1),
+      bitBuffer(0), bitCount(0), headerWritten(false), blockOpen(false), adler(1) {
+    level = std::max(1, std::min(9, level));
+    maxChain = MAX_CHAIN[level];
+    lazyMatching = level >= 4;
+}
+
+void DeflateStream::setDictionary(const uint8_t* data, size_t size) {
+    if (size > static_cast<size_t>(WINDOW_SIZE)) {
+        data += size - WINDOW_SIZE;
+        size = WINDOW_SIZE;
+    }
+    buffer.assign(data, data + size);
+    for (size_t i = 0; i + MIN_MATCH <= buffer.size(); ++i) {
+        insertHash(i);
+    }
+    position = buffer.size();
+}
+
+void DeflateStream::write(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    writeHeader();
+    adler = adler32(adler, data, size);
+    buffer.insert(buffer.end(), data, data + size);
+
+    if (buffer.size() - position >= CHUNK_SIZE + MAX_MATCH) {
+        compress(false);
+        slideWindow();
+    }
+
+    out.insert(out.end(), output.begin(), output.end());
+    output.clear();
+}
+
+void DeflateStream::flush(std::vector<uint8_t>& out) {
+    writeHeader();
+    compress(true);
+
+    if (blockOpen) {
+        putBits(tables().literalCode[END_OF_BLOCK], tables().literalLength[END_OF_BLOCK]);
+        blockOpen = false;
+    }
+    // Empty stored block: header bits, byte alignment, then LEN = 0 and NLEN = 0xFFFF
+    putBits(0, 3);
+    alignToByte();
+    output.push_back(0x00);
+    output.push_back(0x00);
+    output.push_back(0xFF);
+    output.push_back(0xFF);
+
+    slideWindow();
+    out.insert(out.end(), output.begin(), output.end());
+    output.clear();
+}
+
+void DeflateStream::finish(std::vector<uint8_t>& out) {
+    writeHeader();
+    compress(true);
+
+    if (blockOpen) {
+        putBits(tables().literalCode[END_OF_BLOCK], tables().literalLength[END_OF_BLOCK]);
+        blockOpen = false;
+    }
+    // Empty final fixed-Huffman block terminates the stream
+    putBits(1, 1);
+    putBits(1, 2);
+    putBits(tables().literalCode[END_OF_BLOCK], tables().literalLength[END_OF_BLOCK]);
+    alignToByte();
+
+    if (zlibWrapper) {
+        output.push_back(static_cast<uint8_t>(adler >> 24));
+        output.push_back(static_cast<uint8_t>(adler >> 16));
+        output.push_back(static_cast<uint8_t>(adler >> 8));
+        output.push_back(static_cast<uint8_t>(adler));
+    }
+
+    out.insert(out.end(), output.begin(), output.end());
+    output.clear();
+    buffer.clear();
+}
+
+uint32_t DeflateStream::adler32(uint32_t adler, const uint8_t* data, size_t size) {
+    const uint32_t MOD_ADLER = 65521;
+    // Largest block that cannot overflow 32-bit sums before the modulo
+    const size_t NMAX = 5552;
+
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+    while (size > 0) {
+        size_t block = std::min(size, NMAX);
+        size -= block;
+        while (block--) {
+            a += *data++;
+            b += a;
+        }
+        a %= MOD_ADLER;
+        b %= MOD_ADLER;
+    }
+    return (b << 16) | a;
+}
+
+uint32_t DeflateStream::adler32Combine(uint32_t adler1, uint32_t adler2, size_t length2) {
+    // Same arithmetic as zlib's adler32_combine
+    const uint64_t MOD_ADLER = 65521;
+    uint64_t remainder = length2 % MOD_ADLER;
+    uint64_t sum1 = adler1 & 0xFFFF;
+    uint64_t sum2 = (remainder * sum1) % MOD_ADLER;
+    sum1 += (adler2 & 0xFFFF) + MOD_ADLER - 1;
+    sum2 += (adler1 >> 16) + (adler2 >> 16) + MOD_ADLER - remainder;
+    if (sum1 >= MOD_ADLER) sum1 -= MOD_ADLER;
+    if (sum1 >= MOD_ADLER) sum1 -= MOD_ADLER;
+    if (sum2 >= (MOD_ADLER << 1)) sum2 -= (MOD_ADLER << 1);
+    if (sum2 >= MOD_ADLER) sum2 -= MOD_ADLER;
+    return static_cast<uint32_t>(sum1 | (sum2 << 16));
+}
+
+uint32_t DeflateStream::crc32(uint32_t crc, const uint8_t* data, size_t size) {
+    const uint32_t* table = tables().crcTable;
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void DeflateStream::compress(bool flushAll) {
+    size_t limit = buffer.size();
+    if (!flushAll) {
+        // Keep a full match length of lookahead until more input arrives
+        limit = buffer.size() > static_cast<size_t>(MAX_MATCH) ? buffer.size() - MAX_MATCH : 0;
+    }
+
+    while (position < limit) {
+        int distance = 0;
+        int length = 0;
+        if (position + MIN_MATCH <= buffer.size()) {
+            length = findMatch(position, distance);
+            insertHash(position);
+        }
+
+        // Lazy matching: emit a literal if the next byte starts a longer match
+        if (length >= MIN_MATCH && lazyMatching && position + 1 + MIN_MATCH <= buffer.size()) {
+            int nextDistance = 0;
+            if (findMatch(position + 1, nextDistance) > length) {
+                length = 0;
+            }
+        }
+
+        if (length >= MIN_MATCH) {
+            emitMatch(length, distance);
+            for (int k = 1; k < length; ++k) {
+                if (position + k + MIN_MATCH <= buffer.size()) {
+                    insertHash(position + k);
+                }
+            }
+            position += length;
+        } else {
+            emitLiteral(buffer[position]);
+            ++position;
+        }
+    }
+}
+
+void DeflateStream::slideWindow() {
+    if (position <= static_cast<size_t>(2 * WINDOW_SIZE)) return;
+
+    size_t drop = position - WINDOW_SIZE;
+    buffer.erase(buffer.begin(), buffer.begin() + drop);
+    bufferStart += drop;
+    position -= drop;
+}
+
+void DeflateStream::insertHash(size_t index) {
+    uint32_t h = hash3(&buffer[index]);
+    int64_t absolute = bufferStart + static_cast<int64_t>(index);
+    prev[absolute & WINDOW_MASK] = head[h];
+    head[h] = absolute;
+}
+
+int DeflateStream::findMatch(size_t index, int& distance) const {
+    int64_t absolute = bufferStart + static_cast<int64_t>(index);
+    int64_t minimum = std::max(bufferStart, absolute - WINDOW_SIZE);
+    int maxLength = static_cast<int>(std::min<size_t>(MAX_MATCH, buffer.size() - index));
+    const uint8_t* target = &buffer[index];
+
+    int bestLength = 0;
+    int64_t candidate = head[hash3(target)];
+    for (int chain = maxChain; chain > 0 && candidate >= minimum && candidate < absolute; --chain) {
+        const uint8_t* match = &buffer[candidate - bufferStart];
+        if (match[bestLength] == target[bestLength]) {
+            int length = 0;
+            while (length < maxLength && match[length] == target[length]) ++length;
+            if (length > bestLength) {
+                bestLength = length;
+                distance = static_cast<int>(absolute - candidate);
+                if (length == maxLength) break;
+            }
+        }
+
+        int64_t next = prev[candidate & WINDOW_MASK];
+        if (next >= candidate) break;
+        candidate = next;
+    }
+    return bestLength >= MIN_MATCH ? bestLength : 0;
+}
+
+void DeflateStream::putBits(uint32_t value, int count) {
+    bitBuffer |= static_cast<uint64_t>(value) << bitCount;
+    bitCount += count;
+    while (bitCount >= 8) {
+        output.push_back(static_cast<uint8_t>(bitBuffer));
+        bitBuffer >>= 8;
+        bitCount -= 8;
+    }
+}
+
+void DeflateStream::alignToByte() {
+    if (bitCount > 0) {
+        putBits(0, 8 - bitCount);
+    }
+}
+
+void DeflateStream::writeHeader() {
+    if (headerWritten || !zlibWrapper) return;
+    // CMF/FLG: deflate with a 32 KB window, default compression
+    output.push_back(0x78);
+    output.push_back(0x9C);
+    headerWritten = true;
+}
+
+void DeflateStream::openBlock() {
+    if (blockOpen) return;
+    putBits(0, 1);  // BFINAL = 0
+    putBits(1, 2);  // BTYPE = 01, fixed Huffman
+    blockOpen = true;
+}
+
+void DeflateStream::emitLiteral(uint8_t value) {
+    openBlock();
+    putBits(tables().literalCode[value], tables().literalLength[value]);
+}
+
+void DeflateStream::emitMatch(int length, int distance) {
+    const FixedTables& t = tables();
+    openBlock();
+
+    int lengthSymbol = t.lengthSymbol[length];
+    putBits(t.literalCode[257 + lengthSymbol], t.literalLength[257 + lengthSymbol]);
+    if (LENGTH_EXTRA[lengthSymbol]) {
+        putBits(length - LENGTH_BASE[lengthSymbol], LENGTH_EXTRA[lengthSymbol]);
+    }
+
+    int distSymbol = distance <= 256 ? t.distSymbolLow[distance - 1] : t.distSymbolHigh[(distance - 1) >> 7];
+    putBits(reverseBits(distSymbol, 5), 5);
+    if (DIST_EXTRA[distSymbol]) {
+        putBits(distance - DIST_BASE[distSymbol], DIST_EXTRA[distSymbol]);
+    }
+}
+
+ParallelDeflate::ParallelDeflate(int level, unsigned int threads)
+    : level(level), threadCount(threads), headerWritten(false), adler(1) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+void ParallelDeflate::write(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    while (size > 0) {
+        size_t take = std::min(size, PARALLEL_BLOCK_SIZE - current.size());
+        current.insert(current.end(), data, data + take);
+        data += take;
+        size -= take;
+
+        if (current.size() == PARALLEL_BLOCK_SIZE) {
+            pending.push_back(std::move(current));
+            current.clear();
+            if (pending.size() == threadCount) {
+                compressPending(false, out);
+            }
+        }
+    }
+}
+
+void ParallelDeflate::finish(std::vector<uint8_t>& out) {
+    if (!current.empty()) {
+        pending.push_back(std::move(current));
+        current.clear();
+    }
+    compressPending(true, out);
+
+    out.push_back(static_cast<uint8_t>(adler >> 24));
+    out.push_back(static_cast<uint8_t>(adler >> 16));
+    out.push_back(static_cast<uint8_t>(adler >> 8));
+    out.push_back(static_cast<uint8_t>(adler));
+}
+
+void ParallelDeflate::compressPending(bool last, std::vector<uint8_t>& out) {
+    if (!headerWritten) {
+        out.push_back(0x78);
+        out.push_back(0x9C);
+        headerWritten = true;
+    }
+
+    size_t count = pending.size();
+    if (count == 0) {
+        if (last) {
+            DeflateStream terminator(level, false);
+            terminator.finish(out);
+        }
+        return;
+    }
+
+    std::vector<std::vector<uint8_t>> results(count);
+    std::vector<uint32_t> checksums(count);
+
+    auto compressBlock = [&](size_t i) {
+        DeflateStream stream(level, false);
+        const std::vector<uint8_t>& previous = i == 0 ? dictionary : pending[i - 1];
+        size_t dictionarySize = std::min<size_t>(previous.size(), WINDOW_SIZE);
+        stream.setDictionary(previous.data() + previous.size() - dictionarySize, dictionarySize);
+
+        Trace::Scope trace("deflate block", "encode");
+        trace.arg("bytes", static_cast<long long>(pending[i].size()));
+        stream.write(pending[i].data(), pending[i].size(), results[i]);
+        if (last && i == count - 1) {
+            stream.finish(results[i]);
+        } else {
+            stream.flush(results[i]);
+        }
+        checksums[i] = DeflateStream::adler32(1, pending[i].data(), pending[i].size());
+    };
+
+    if (count == 1) {
+        compressBlock(0);
+    } else {
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < count; ++i) {
+            workers.emplace_back([&compressBlock, i]() {
+                Trace::setThreadName("deflate worker");
+                compressBlock(i);
+            });
+        }
+        compressBlock(0);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        out.insert(out.end(), results[i].begin(), results[i].end());
+        adler = DeflateStream::adler32Combine(adler, checksums[i], pending[i].size());
+    }
+
+    size_t keep = std::min<size_t>(pending.back().size(), WINDOW_SIZE);
+    dictionary.assign(pending.back().end() - keep, pending.back().end());
+    pending.clear();
+}
\ No newline at end of file
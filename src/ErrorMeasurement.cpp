@@ -1,4 +1,5 @@
 #include "ErrorMeasurement.hpp"
+#include "Stats.hpp"
 #include <cmath>
 #include <array>
 
@@ -230,6 +231,8 @@ double ErrorMeasurement::calculateError(const std::vector<std::vector<RGB>>& ima
     } else if (method == "ENT") {
         return calculateEntropy(image, x, y, width, height);
     } else if (method == "SSIM") {
+        static Stats::AllocationSite site("ssim_region");
+        Stats::AllocationScope allocations(site);
         std::vector<std::vector<RGB>> compressedRegion(height, std::vector<RGB>(width));
 
         for (int i = 0; i < height; i++) {
@@ -4,115 +4,384 @@
 #include "Utils.hpp"
 #include <vector>
 #include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include "Palette.hpp"
+#include "Stats.hpp"
+#include "Trace.hpp"
 
 #define GIF_WRITER_IMPLEMENTATION
 #include "gif.h"
 
-void traverseQuadTree(const QuadTreeNode* node, std::vector<QuadTreeNode*>& nodeOrder, bool leafNodesOnly = false) {
-    if (!node) return;
-    if (!leafNodesOnly || node->isNodeLeaf()) nodeOrder.push_back(const_cast<QuadTreeNode*>(node));
-    if (!node->isNodeLeaf()) {
-        for (int i = 0; i < 4; ++i) traverseQuadTree(node->getChildAt(i), nodeOrder, leafNodesOnly);
+namespace {
+    RGB borderColorOf(const RGB& color) {
+        return {static_cast<uint8_t>(color.r * 0.9), static_cast<uint8_t>(color.g * 0.9), static_cast<uint8_t>(color.b * 0.9)};
+    }
+
+    void addColor(const RGB& color, long long weight,
+                  std::unordered_map<uint32_t, size_t>& indexByColor,
+                  std::vector<Palette::Entry>& colors) {
+        auto inserted = indexByColor.insert(std::make_pair(Palette::packColor(color), colors.size()));
+        if (inserted.second) {
+            colors.push_back({color, weight});
+        } else {
+            colors[inserted.first->second].weight += weight;
+        }
+    }
+
+    void collectNodeColors(const QuadTreeNode* node,
+                           std::unordered_map<uint32_t, size_t>& indexByColor,
+                           std::vector<Palette::Entry>& colors) {
+        if (!node) return;
+        int width = node->getBlockWidth(), height = node->getBlockHeight();
+        addColor(node->getAverageColor(), static_cast<long long>(width) * height, indexByColor, colors);
+        if (width > 1 || height > 1) {
+            addColor(borderColorOf(node->getAverageColor()), 2LL * (width + height), indexByColor, colors);
+        }
+        if (!node->isNodeLeaf()) {
+            for (int i = 0; i < 4; ++i) collectNodeColors(node->getChildAt(i), indexByColor, colors);
+        }
+    }
+
+    // Index 0 is gif.h's transparent color, leaving 255 entries for the image
+    const size_t MAX_GIF_COLORS = 255;
+
+    // Blocks waiting to be encoded before writeLevel makes the build wait (about 20 MB);
+    // a single larger level is still accepted once the queue is empty
+    const size_t MAX_QUEUED_BLOCKS = 1 << 20;
+}
+
+GifGenerator::FrameBuffer::FrameBuffer(int width, int height, const RGB& background)
+    : width(width), height(height), pixels(static_cast<size_t>(width) * height * 4) {
+    fillRect(0, 0, width, height, background);
+}
+
+void GifGenerator::FrameBuffer::fillRect(int x, int y, int w, int h, const RGB& color) {
+    int x0 = std::max(0, x), y0 = std::max(0, y);
+    int x1 = std::min(x + w, width), y1 = std::min(y + h, height);
+    if (x1 <= x0 || y1 <= y0) return;
+
+    const uint8_t rgba[4] = {color.r, color.g, color.b, 255};
+    for (int row = y0; row < y1; ++row) {
+        uint8_t* p = &pixels[(static_cast<size_t>(row) * width + x0) * 4];
+        for (int col = x0; col < x1; ++col, p += 4) {
+            std::memcpy(p, rgba, 4);
+        }
     }
 }
 
 std::vector<std::vector<RGB>> GifGenerator::createQuadTreeFrame(const QuadTreeNode* node, int width, int height, bool showBorders) {
-    std::vector<std::vector<RGB>> frame(height, std::vector<RGB>(width, {255, 255, 255}));
-    drawNode(frame, node, showBorders);
+    FrameBuffer buffer(width, height, {255, 255, 255});
+    drawNode(buffer, node, showBorders);
+
+    std::vector<std::vector<RGB>> frame(height, std::vector<RGB>(width));
+    for (int i = 0; i < height; ++i) {
+        for (int j = 0; j < width; ++j) {
+            const uint8_t* p = &buffer.pixels[(static_cast<size_t>(i) * width + j) * 4];
+            frame[i][j] = {p[0], p[1], p[2]};
+        }
+    }
     return frame;
 }
 
-bool GifGenerator::generateCompressionGif(const std::vector<std::vector<RGB>>& originalImage, const QuadTree& tree, const std::string& outputFilename, int frameDelay) {
-    if (originalImage.empty() || originalImage[0].empty()) return false;
+GifGenerator::AnimationWriter::AnimationWriter()
+    : file(nullptr), frameDelay(10), frame(0, 0, {255, 255, 255}), firstFrame(true), paletteFixed(false),
+      queuedBlocks(0), closing(false), failed(false) {
+}
+
+GifGenerator::AnimationWriter::~AnimationWriter() {
+    stopWorker();
+    if (file) {
+        GifWriter writer = {0};
+        writer.f = file;
+        GifEnd(&writer);
+    }
+}
+
+namespace {
+    // Frame buffers, palettes and index buffers of the animation
+    Stats::AllocationSite& gifAllocations() {
+        static Stats::AllocationSite site("gif_frames");
+        return site;
+    }
+}
+
+bool GifGenerator::AnimationWriter::begin(const std::string& filename, int width, int height, int frameDelay) {
+    if (file || width <= 0 || height <= 0) return false;
+    Stats::AllocationScope allocations(gifAllocations());
 
-    int height = originalImage.size(), width = originalImage[0].size();
-    std::string normalizedPath = Utils::normalizePath(outputFilename);
+    std::string normalizedPath = Utils::normalizePath(filename);
     std::string dirPath = Utils::getDirectoryPath(normalizedPath);
 
     if (!dirPath.empty() && !Utils::fileExists(dirPath) && !Utils::createDirectory(dirPath)) {
         normalizedPath = Utils::getFileNameFromPath(normalizedPath);
     }
 
-    std::vector<std::vector<QuadTreeNode*>> nodesByLevel;
-    collectNodesByLevel(tree.getRoot(), nodesByLevel);
-
+    // gif.h writes the header; its full-canvas delta buffer is not needed since frames
+    // are palettized here
     GifWriter writer = {0};
     if (!GifBegin(&writer, normalizedPath.c_str(), width, height, frameDelay)) return false;
+    GIF_FREE(writer.oldImage);
 
-    for (size_t level = 0; level < nodesByLevel.size(); ++level) {
-        std::vector<std::vector<RGB>> frameImage(height, std::vector<RGB>(width, {255, 255, 255}));
-        for (size_t l = 0; l <= level; ++l) {
-            for (QuadTreeNode* node : nodesByLevel[l]) {
-                if (node->isNodeLeaf() || l == level) drawNode(frameImage, node, true);
-            }
+    file = writer.f;
+    this->frameDelay = frameDelay;
+    frame = FrameBuffer(width, height, {255, 255, 255});
+    shown.assign(frame.pixels.size(), 0);
+    firstFrame = true;
+    paletteEntries.clear();
+    paletteIndex.clear();
+    paletteFixed = false;
+    queue.clear();
+    queuedBlocks = 0;
+    closing = failed = false;
+    return true;
+}
+
+void GifGenerator::AnimationWriter::fixPalette(const QuadTree& tree) {
+    // Every pixel of the animation is a node color, its border shade or the background
+    std::unordered_map<uint32_t, size_t> indexByColor;
+    std::vector<Palette::Entry> colors;
+    addColor({255, 255, 255}, 1, indexByColor, colors);
+    collectNodeColors(tree.getRoot(), indexByColor, colors);
+
+    if (colors.size() <= MAX_GIF_COLORS) {
+        paletteEntries.clear();
+        for (const Palette::Entry& entry : colors) paletteEntries.push_back(entry.color);
+    } else {
+        paletteEntries = Palette::medianCut(colors, MAX_GIF_COLORS);
+    }
+
+    paletteIndex.clear();
+    for (const Palette::Entry& entry : colors) {
+        int index = Palette::nearestIndex(paletteEntries, entry.color) + 1;
+        paletteIndex.insert(std::make_pair(Palette::packColor(entry.color), static_cast<uint8_t>(index)));
+    }
+    paletteFixed = true;
+}
+
+void GifGenerator::AnimationWriter::fixPalette(const std::vector<std::vector<RGB>>& image) {
+    std::vector<Palette::Entry> colors = Palette::collectImageColors(image);
+    if (colors.size() <= MAX_GIF_COLORS) {
+        paletteEntries.clear();
+        for (const Palette::Entry& entry : colors) paletteEntries.push_back(entry.color);
+    } else {
+        paletteEntries = Palette::medianCut(colors, MAX_GIF_COLORS);
+    }
+    paletteIndex.clear();
+    paletteFixed = true;
+}
+
+uint8_t GifGenerator::AnimationWriter::paletteIndexOf(const RGB& color) {
+    uint32_t key = Palette::packColor(color);
+    auto found = paletteIndex.find(key);
+    if (found != paletteIndex.end()) return found->second;
+
+    // A growing palette takes new colors until it is full; entries never change, so the
+    // indices of earlier frames stay valid. Later colors use their nearest entry.
+    uint8_t index;
+    if (!paletteFixed && paletteEntries.size() < MAX_GIF_COLORS) {
+        paletteEntries.push_back(color);
+        index = static_cast<uint8_t>(paletteEntries.size());
+    } else {
+        index = static_cast<uint8_t>(Palette::nearestIndex(paletteEntries, color) + 1);
+    }
+    paletteIndex.insert(std::make_pair(key, index));
+    return index;
+}
+
+bool GifGenerator::AnimationWriter::writeLevel(const std::vector<QuadTreeNode*>& nodes) {
+    if (!file) return false;
+
+    std::vector<Block> blocks;
+    {
+        Stats::AllocationScope allocations(gifAllocations());
+        blocks.reserve(nodes.size());
+        for (const QuadTreeNode* node : nodes) {
+            blocks.push_back({node->getPosX(), node->getPosY(), node->getBlockWidth(), node->getBlockHeight(),
+                              node->getAverageColor()});
         }
-        uint8_t* frameData = new uint8_t[width * height * 4]();
-        for (int i = 0; i < height; ++i) {
-            for (int j = 0; j < width; ++j) {
-                int idx = (i * width + j) * 4;
-                frameData[idx] = frameImage[i][j].r;
-                frameData[idx + 1] = frameImage[i][j].g;
-                frameData[idx + 2] = frameImage[i][j].b;
-                frameData[idx + 3] = 255;
-            }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this, &blocks]() {
+        return queuedBlocks == 0 || queuedBlocks + blocks.size() <= MAX_QUEUED_BLOCKS;
+    });
+    queuedBlocks += blocks.size();
+    queue.push_back(std::move(blocks));
+    if (!worker.joinable()) {
+        worker = std::thread(&AnimationWriter::encodeLevels, this);
+    }
+    changed.notify_all();
+    return !failed;
+}
+
+void GifGenerator::AnimationWriter::encodeLevels() {
+    Trace::setThreadName("gif");
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        changed.wait(lock, [this]() { return closing || !queue.empty(); });
+        if (queue.empty()) return;
+
+        std::vector<Block> blocks = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+        bool written;
+        {
+            Stats::ScopedPhase phase("gif");
+            written = encodeLevel(blocks);
         }
-        if (!GifWriteFrame(&writer, frameData, width, height, frameDelay)) {
-            delete[] frameData;
-            GifEnd(&writer);
-            return false;
+        size_t count = blocks.size();
+        std::vector<Block>().swap(blocks);
+        lock.lock();
+
+        queuedBlocks -= count;
+        failed = failed || !written;
+        changed.notify_all();
+    }
+}
+
+bool GifGenerator::AnimationWriter::encodeLevel(const std::vector<Block>& blocks) {
+    Stats::AllocationScope allocations(gifAllocations());
+
+    // Children tile their parent exactly, so each frame only needs to draw its own level
+    // on top of the previous frame: leaves from earlier levels are never overwritten.
+    // Only the bounding box of the level's blocks is encoded; the frames keep the previous
+    // pixels outside of it.
+    int left = frame.width, top = frame.height, right = 0, bottom = 0;
+    for (const Block& block : blocks) {
+        drawBlock(frame, block.x, block.y, block.width, block.height, block.color, true);
+
+        // Block colors enter a growing palette ahead of their border shades
+        if (!paletteFixed) paletteIndexOf(block.color);
+
+        left = std::min(left, block.x);
+        top = std::min(top, block.y);
+        right = std::max(right, block.x + block.width);
+        bottom = std::max(bottom, block.y + block.height);
+    }
+    left = std::max(left, 0);
+    top = std::max(top, 0);
+    right = std::min(right, frame.width);
+    bottom = std::min(bottom, frame.height);
+    if (right <= left || bottom <= top) return true;
+
+    return writeRegion(left, top, right - left, bottom - top, frameDelay);
+}
+
+void GifGenerator::AnimationWriter::stopWorker() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+        changed.notify_all();
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+bool GifGenerator::AnimationWriter::finish(const QuadTree& tree) {
+    if (!file) return false;
+    stopWorker();
+    Stats::AllocationScope allocations(gifAllocations());
+
+    // Final frame: the compressed image without block borders
+    drawLeaves(frame, tree.getRoot());
+    bool written = writeRegion(0, 0, frame.width, frame.height, frameDelay * 2) && !failed;
+
+    GifWriter writer = {0};
+    writer.f = file;
+    file = nullptr;
+    return GifEnd(&writer) && written;
+}
+
+bool GifGenerator::AnimationWriter::writeRegion(int left, int top, int width, int height, int delay) {
+    // Pixels that match the previously written canvas stay transparent
+    std::vector<uint8_t> indices(static_cast<size_t>(width) * height * 4);
+    uint32_t lastColor = 0xFFFFFFFF;
+    uint8_t lastIndex = 0;
+    for (int row = 0; row < height; ++row) {
+        size_t offset = (static_cast<size_t>(top + row) * frame.width + left) * 4;
+        const uint8_t* src = &frame.pixels[offset];
+        uint8_t* seen = &shown[offset];
+        uint8_t* out = &indices[static_cast<size_t>(row) * width * 4];
+        for (int col = 0; col < width; ++col, src += 4, seen += 4, out += 4) {
+            if (!firstFrame && src[0] == seen[0] && src[1] == seen[1] && src[2] == seen[2]) {
+                out[3] = kGifTransIndex;
+                continue;
+            }
+            uint32_t color = (static_cast<uint32_t>(src[0]) << 16) | (static_cast<uint32_t>(src[1]) << 8) | src[2];
+            if (color != lastColor) {
+                lastIndex = paletteIndexOf({src[0], src[1], src[2]});
+                lastColor = color;
+            }
+            out[3] = lastIndex;
+            std::memcpy(seen, src, 4);
         }
-        delete[] frameData;
     }
 
-    std::vector<std::vector<RGB>> finalFrame;
-    tree.saveToImage(finalFrame);
-    uint8_t* finalFrameData = new uint8_t[width * height * 4]();
-    for (int i = 0; i < height; ++i) {
-        for (int j = 0; j < width; ++j) {
-            int idx = (i * width + j) * 4;
-            if (i < finalFrame.size() && j < finalFrame[0].size()) {
-                finalFrameData[idx] = finalFrame[i][j].r;
-                finalFrameData[idx + 1] = finalFrame[i][j].g;
-                finalFrameData[idx + 2] = finalFrame[i][j].b;
-            } else {
-                finalFrameData[idx] = finalFrameData[idx + 1] = finalFrameData[idx + 2] = 255;
+    // gif.h has no global color table, so the palette as of this frame is its local table
+    GifPalette table;
+    std::memset(&table, 0, sizeof(table));
+    table.bitDepth = 8;
+    for (size_t i = 0; i < paletteEntries.size(); ++i) {
+        table.r[i + 1] = paletteEntries[i].r;
+        table.g[i + 1] = paletteEntries[i].g;
+        table.b[i + 1] = paletteEntries[i].b;
+    }
+
+    firstFrame = false;
+    GifWriteLzwImage(file, indices.data(), left, top, width, height, delay, &table);
+    return !ferror(file);
+}
+
+bool GifGenerator::generateCompressionGif(const std::vector<std::vector<RGB>>& originalImage, const QuadTree& tree, const std::string& outputFilename, int frameDelay) {
+    if (originalImage.empty() || originalImage[0].empty()) return false;
+
+    AnimationWriter writer;
+    if (!writer.begin(outputFilename, originalImage[0].size(), originalImage.size(), frameDelay)) return false;
+    writer.fixPalette(tree);
+
+    // Walk the finished tree breadth-first, one level per frame
+    std::vector<QuadTreeNode*> level(1, tree.getRoot()), next;
+    while (!level.empty() && level[0]) {
+        if (!writer.writeLevel(level)) return false;
+
+        next.clear();
+        for (QuadTreeNode* node : level) {
+            if (node->isNodeLeaf()) continue;
+            for (int i = 0; i < 4; ++i) {
+                if (node->getChildAt(i)) next.push_back(node->getChildAt(i));
             }
-            finalFrameData[idx + 3] = 255;
         }
+        level.swap(next);
     }
-    GifWriteFrame(&writer, finalFrameData, width, height, frameDelay * 2);
-    delete[] finalFrameData;
 
-    return GifEnd(&writer);
+    return writer.finish(tree);
 }
 
-void GifGenerator::drawNode(std::vector<std::vector<RGB>>& frame, const QuadTreeNode* node, bool showBorders) {
+void GifGenerator::drawNode(FrameBuffer& frame, const QuadTreeNode* node, bool showBorders) {
     if (!node) return;
-    int x = node->getPosX(), y = node->getPosY(), width = node->getBlockWidth(), height = node->getBlockHeight();
-    RGB color = node->getAverageColor();
+    drawBlock(frame, node->getPosX(), node->getPosY(), node->getBlockWidth(), node->getBlockHeight(),
+              node->getAverageColor(), showBorders);
+}
 
-    for (int i = y; i < std::min(y + height, (int)frame.size()); ++i) {
-        for (int j = x; j < std::min(x + width, (int)frame[0].size()); ++j) frame[i][j] = color;
-    }
+void GifGenerator::drawBlock(FrameBuffer& frame, int x, int y, int width, int height, const RGB& color, bool showBorders) {
+    frame.fillRect(x, y, width, height, color);
 
     if (showBorders && (width > 1 || height > 1)) {
-        RGB borderColor = {static_cast<uint8_t>(color.r * 0.9), static_cast<uint8_t>(color.g * 0.9), static_cast<uint8_t>(color.b * 0.9)};
-        for (int j = x; j < std::min(x + width, (int)frame[0].size()); ++j) {
-            if (y < frame.size()) frame[y][j] = borderColor;
-            if (y + height - 1 < frame.size()) frame[y + height - 1][j] = borderColor;
-        }
-        for (int i = y; i < std::min(y + height, (int)frame.size()); ++i) {
-            if (x < frame[0].size()) frame[i][x] = borderColor;
-            if (x + width - 1 < frame[0].size()) frame[i][x + width - 1] = borderColor;
-        }
+        RGB borderColor = borderColorOf(color);
+        frame.fillRect(x, y, width, 1, borderColor);
+        frame.fillRect(x, y + height - 1, width, 1, borderColor);
+        frame.fillRect(x, y, 1, height, borderColor);
+        frame.fillRect(x + width - 1, y, 1, height, borderColor);
     }
 }
 
-void GifGenerator::collectNodesByLevel(const QuadTreeNode* node, std::vector<std::vector<QuadTreeNode*>>& nodesByLevel, int level) {
+void GifGenerator::drawLeaves(FrameBuffer& frame, const QuadTreeNode* node) {
     if (!node) return;
-    if (nodesByLevel.size() <= level) nodesByLevel.push_back({});
-    nodesByLevel[level].push_back(const_cast<QuadTreeNode*>(node));
-    if (!node->isNodeLeaf()) {
-        for (int i = 0; i < 4; ++i) collectNodesByLevel(node->getChildAt(i), nodesByLevel, level + 1);
+    if (node->isNodeLeaf()) {
+        frame.fillRect(node->getPosX(), node->getPosY(), node->getBlockWidth(), node->getBlockHeight(), node->getAverageColor());
+        return;
     }
-}
\ No newline at end of file
+    for (int i = 0; i < 4; ++i) drawLeaves(frame, node->getChildAt(i));
+}
@@ -3,20 +3,93 @@
 #include <algorithm>
 #include <stdexcept>
 #include <iostream>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <sstream>
+#include <chrono>
 #include "Utils.hpp"
+#include "PngWriter.hpp"
+#include "JpegWriter.hpp"
+#include "NetpbmWriter.hpp"
+#include "Palette.hpp"
+#include "Stats.hpp"
 
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace {
+    std::string lowercaseExtension(const std::string& filename) {
+        std::string extension = Utils::getFileExtension(filename);
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        return extension;
+    }
+
+    bool isNetpbmExtension(const std::string& extension) {
+        return extension == "ppm" || extension == "pgm" || extension == "pnm" || extension == "pam";
+    }
+
+    // Reads a whole file, or standard input for "-"
+    bool readAll(const std::string& filename, std::vector<unsigned char>& bytes) {
+        if (filename == "-") {
+#ifdef _WIN32
+            _setmode(_fileno(stdin), _O_BINARY);
+#endif
+            unsigned char chunk[64 * 1024];
+            size_t count;
+            while ((count = std::fread(chunk, 1, sizeof(chunk), stdin)) > 0) {
+                bytes.insert(bytes.end(), chunk, chunk + count);
+            }
+            return !std::ferror(stdin);
+        }
+
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) return false;
+        bytes.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        return static_cast<bool>(file.read(reinterpret_cast<char*>(bytes.data()), bytes.size()));
+    }
+
+    // Next decimal number of a P5/P6 header, skipping whitespace and # comments
+    bool readHeaderNumber(const unsigned char* data, size_t size, size_t& pos, int& value) {
+        while (pos < size && (std::isspace(data[pos]) || data[pos] == '#')) {
+            if (data[pos] == '#') {
+                while (pos < size && data[pos] != '\n') ++pos;
+            } else {
+                ++pos;
+            }
+        }
+        size_t start = pos;
+        value = 0;
+        while (pos < size && std::isdigit(data[pos]) && pos - start < 9) {
+            value = value * 10 + (data[pos++] - '0');
+        }
+        return pos > start;
+    }
+}
 
 
 std::vector<std::vector<RGB>> ImageProcessor::loadImage(const std::string& filename) {
 
     std::string normalizedPath = Utils::normalizePath(filename);
 
+    // Standard input, and Netpbm files whose rows can be copied as they are, are read whole
+    if (normalizedPath == "-" || isNetpbmExtension(lowercaseExtension(normalizedPath))) {
+        std::vector<unsigned char> bytes;
+        if (!readAll(normalizedPath, bytes)) {
+            std::cerr << "Error: Could not read image file: " << normalizedPath << std::endl;
+            throw std::runtime_error("Failed to load image: " + normalizedPath);
+        }
+        return loadImageFromMemory(bytes.data(), bytes.size());
+    }
+
     int width, height, channels;
 
     unsigned char* data = stbi_load(normalizedPath.c_str(), &width, &height, &channels, 0);
@@ -26,6 +99,41 @@ std::vector<std::vector<RGB>> ImageProcessor::loadImage(const std::string& filen
         throw std::runtime_error("Failed to load image: " + normalizedPath);
     }
 
+    std::vector<std::vector<RGB>> image = convertPixels(data, width, height, channels);
+    stbi_image_free(data);
+
+    std::cout << "Successfully loaded image: " << normalizedPath << std::endl;
+    std::cout << "Image dimensions: " << width << "x" << height << " with " << channels << " channels" << std::endl;
+
+    return image;
+}
+
+std::vector<std::vector<RGB>> ImageProcessor::loadImageFromMemory(const unsigned char* bytes, size_t size) {
+    std::vector<std::vector<RGB>> image;
+    if (decodeNetpbm(bytes, size, image)) {
+        std::cout << "Read raw Netpbm image: " << image[0].size() << "x" << image.size() << std::endl;
+        return image;
+    }
+
+    int width, height, channels;
+
+    unsigned char* data = stbi_load_from_memory(bytes, static_cast<int>(size), &width, &height, &channels, 0);
+    if (!data) {
+        throw std::runtime_error(std::string("Failed to decode image: ") + stbi_failure_reason());
+    }
+
+    image = convertPixels(data, width, height, channels);
+    stbi_image_free(data);
+
+    std::cout << "Decoded image from memory: " << width << "x" << height << " with " << channels << " channels" << std::endl;
+
+    return image;
+}
+
+std::vector<std::vector<RGB>> ImageProcessor::convertPixels(const unsigned char* data, int width, int height, int channels) {
+    // stbi_load itself uses malloc, so only the row buffers are counted
+    static Stats::AllocationSite site("image_buffers");
+    Stats::AllocationScope allocations(site);
     std::vector<std::vector<RGB>> image(height, std::vector<RGB>(width));
 
     for (int y = 0; y < height; ++y) {
@@ -38,74 +146,145 @@ std::vector<std::vector<RGB>> ImageProcessor::loadImage(const std::string& filen
         }
     }
 
-    stbi_image_free(data);
-
-    std::cout << "Successfully loaded image: " << normalizedPath << std::endl;
-    std::cout << "Image dimensions: " << width << "x" << height << " with " << channels << " channels" << std::endl;
-
     return image;
 }
 
-bool ImageProcessor::saveImage(const std::vector<std::vector<RGB>>& image, const std::string& filename) {
-    if (image.empty() || image[0].empty()) {
-        std::cerr << "Error: Cannot save empty image" << std::endl;
-        return false;
+bool ImageProcessor::probeImage(const std::string& filename, int& width, int& height, int& channels) {
+    std::string normalizedPath = Utils::normalizePath(filename);
+
+    // A Netpbm header is a few dozen bytes of text
+    if (isNetpbmExtension(lowercaseExtension(normalizedPath))) {
+        std::ifstream file(normalizedPath, std::ios::binary);
+        unsigned char header[4096];
+        file.read(reinterpret_cast<char*>(header), sizeof(header));
+        size_t pos;
+        int maxValue;
+        if (parseNetpbmHeader(header, static_cast<size_t>(file.gcount()), pos, width, height, channels, maxValue)) {
+            return true;
+        }
     }
 
-    // Normalize the path
-    std::string normalizedPath = Utils::normalizePath(filename);
+    return stbi_info(normalizedPath.c_str(), &width, &height, &channels) != 0;
+}
 
-    // Ensure the directory exists
-    std::string dirPath = Utils::getDirectoryPath(normalizedPath);
-    if (!dirPath.empty() && !Utils::fileExists(dirPath)) {
-        std::cout << "Creating directory: " << dirPath << std::endl;
-        if (!Utils::createDirectory(dirPath)) {
-            std::cerr << "Error: Failed to create directory: " << dirPath << std::endl;
+bool ImageProcessor::parseNetpbmHeader(const unsigned char* data, size_t size, size_t& pos,
+                                       int& width, int& height, int& depth, int& maxValue) {
+    if (size < 3 || data[0] != 'P' || data[1] < '5' || data[1] > '7') return false;
+
+    width = height = depth = maxValue = 0;
+    pos = 2;
+    if (data[1] == '7') {
+        // PAM: "KEY value" lines up to ENDHDR
+        for (;;) {
+            size_t end = pos;
+            while (end < size && data[end] != '\n') ++end;
+            if (end == size) return false;
+            std::istringstream line(std::string(reinterpret_cast<const char*>(data) + pos, end - pos));
+            pos = end + 1;
+
+            std::string key;
+            line >> key;
+            if (key == "ENDHDR") break;
+            if (key == "WIDTH") line >> width;
+            else if (key == "HEIGHT") line >> height;
+            else if (key == "DEPTH") line >> depth;
+            else if (key == "MAXVAL") line >> maxValue;
+        }
+    } else {
+        depth = data[1] == '6' ? 3 : 1;
+        if (!readHeaderNumber(data, size, pos, width) || !readHeaderNumber(data, size, pos, height) ||
+            !readHeaderNumber(data, size, pos, maxValue) || pos >= size) {
             return false;
         }
+        ++pos;  // Single whitespace byte before the raster
     }
+    return width > 0 && height > 0 && depth >= 1 && depth <= 4;
+}
 
-    int height = static_cast<int>(image.size());
-    int width = static_cast<int>(image[0].size());
+bool ImageProcessor::decodeNetpbm(const unsigned char* data, size_t size, std::vector<std::vector<RGB>>& image) {
+    size_t pos;
+    int width, height, depth, maxValue;
+
+    // 16-bit samples and other rare variants are left to stb_image
+    if (!parseNetpbmHeader(data, size, pos, width, height, depth, maxValue) || maxValue != 255) return false;
+
+    size_t rowBytes = static_cast<size_t>(width) * depth;
+    if ((size - pos) / rowBytes < static_cast<size_t>(height)) {
+        throw std::runtime_error("Truncated Netpbm image");
+    }
 
-    // Create a buffer for pixel data (RGB format)
-    unsigned char* data = new unsigned char[width * height * 3];
+    static Stats::AllocationSite site("image_buffers");
+    Stats::AllocationScope allocations(site);
+    image.assign(height, std::vector<RGB>(width));
 
-    // Fill the buffer with RGB values
     for (int y = 0; y < height; ++y) {
+        const unsigned char* source = data + pos + y * rowBytes;
+        if (depth == 3) {
+            std::memcpy(image[y].data(), source, rowBytes);
+            continue;
+        }
+        // Grayscale with optional alpha, or RGB with alpha
         for (int x = 0; x < width; ++x) {
-            int index = (y * width + x) * 3;
-            data[index] = static_cast<unsigned char>(image[y][x].r);
-            data[index + 1] = static_cast<unsigned char>(image[y][x].g);
-            data[index + 2] = static_cast<unsigned char>(image[y][x].b);
+            const unsigned char* pixel = source + x * depth;
+            image[y][x] = depth < 3 ? RGB{pixel[0], pixel[0], pixel[0]} : RGB{pixel[0], pixel[1], pixel[2]};
         }
     }
+    return true;
+}
 
-    // Get file extension
-    std::string extension = Utils::getFileExtension(normalizedPath);
-    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+std::string ImageProcessor::outputFormat(const std::string& filename) {
+    std::string format = filename == "-" ? Utils::ProgramOptions::outputFormat : lowercaseExtension(filename);
+    std::transform(format.begin(), format.end(), format.begin(), ::tolower);
+    if (format == "jpeg") return "jpg";
+    if (format == "pnm") return "ppm";
+    return format;
+}
 
-    bool success = false;
-    if (extension == "png") {
-        success = stbi_write_png(normalizedPath.c_str(), width, height, 3, data, width * 3) != 0;
-    } else if (extension == "jpg" || extension == "jpeg") {
-        success = stbi_write_jpg(normalizedPath.c_str(), width, height, 3, data, 90) != 0;
-    } else {
-        // Default to PNG if extension is unsupported
-        std::string newPath = normalizedPath + ".png";
-        std::cout << "Unsupported extension, saving as PNG: " << newPath << std::endl;
-        success = stbi_write_png(newPath.c_str(), width, height, 3, data, width * 3) != 0;
+bool ImageProcessor::saveImage(const std::vector<std::vector<RGB>>& image, const std::string& filename) {
+    if (image.empty() || image[0].empty()) {
+        std::cerr << "Error: Cannot save empty image" << std::endl;
+        return false;
     }
 
-    delete[] data;
+    int height = static_cast<int>(image.size());
+    int width = static_cast<int>(image[0].size());
+
+    return writeImage(width, height, [&image](int y) { return image[y].data(); }, filename);
+}
 
-    if (success) {
-        std::cout << "Successfully saved image to: " << normalizedPath << std::endl;
-    } else {
-        std::cerr << "Error: Failed to save image to: " << normalizedPath << std::endl;
+bool ImageProcessor::saveImage(const QuadTree& tree, const std::string& filename, bool quantizePalette) {
+    const QuadTreeNode* root = tree.getRoot();
+    if (!root || root->getBlockWidth() <= 0 || root->getBlockHeight() <= 0) {
+        std::cerr << "Error: Cannot save empty image" << std::endl;
+        return false;
     }
 
-    return success;
+    // Only one scanline is alive at a time
+    std::vector<RGB> row;
+    auto rowSource = [&tree, &row](int y) {
+        tree.renderRow(y, row);
+        return row.data();
+    };
+
+    // Leaf colors are the only colors in the output, so small sets fit a PNG palette exactly
+    std::vector<RGB> palette;
+    std::string format = outputFormat(filename);
+    if (format != "jpg" && format != "ppm" && format != "pam") {
+        const size_t MAX_PALETTE_SIZE = 256;
+        std::vector<Palette::Entry> colors = Palette::collectLeafColors(tree, quantizePalette ? 0 : MAX_PALETTE_SIZE);
+        if (colors.size() <= MAX_PALETTE_SIZE) {
+            for (const Palette::Entry& entry : colors) {
+                palette.push_back(entry.color);
+            }
+        } else if (quantizePalette) {
+            palette = Palette::medianCut(colors, MAX_PALETTE_SIZE);
+        }
+        if (!palette.empty()) {
+            std::cout << "Writing indexed PNG with " << palette.size() << " palette colors" << std::endl;
+        }
+    }
+
+    return writeImage(root->getBlockWidth(), root->getBlockHeight(), rowSource, filename, palette);
 }
 
 // Extract a region from an image
@@ -130,6 +309,8 @@ std::vector<std::vector<RGB>> ImageProcessor::extractRegion(
     }
 
     // Create the region and copy pixel data
+    static Stats::AllocationSite site("extract_region");
+    Stats::AllocationScope allocations(site);
     std::vector<std::vector<RGB>> region(height, std::vector<RGB>(width));
     for (int j = 0; j < height; ++j) {
         for (int i = 0; i < width; ++i) {
@@ -194,4 +375,73 @@ void ImageProcessor::setPixel(std::vector<std::vector<RGB>>& image, int x, int y
     }
 
     image[y][x] = color;
+}
+
+bool ImageProcessor::writeImage(int width, int height,
+                                const std::function<const RGB*(int)>& rowSource,
+                                const std::string& filename,
+                                const std::vector<RGB>& palette) {
+    // Normalize the path
+    std::string normalizedPath = Utils::normalizePath(filename);
+
+    // Ensure the directory exists
+    std::string dirPath = Utils::getDirectoryPath(normalizedPath);
+    if (!dirPath.empty() && !Utils::fileExists(dirPath)) {
+        std::cout << "Creating directory: " << dirPath << std::endl;
+        if (!Utils::createDirectory(dirPath)) {
+            std::cerr << "Error: Failed to create directory: " << dirPath << std::endl;
+            return false;
+        }
+    }
+
+    // Pick the encoder from the extension, or from --output-format for standard output
+    std::string format = outputFormat(normalizedPath);
+
+    std::string outputPath = normalizedPath;
+    std::unique_ptr<ScanlineWriter> writer;
+    if (format == "jpg") {
+        writer.reset(new JpegWriter(Utils::ProgramOptions::jpegQuality, Utils::ProgramOptions::threads));
+    } else if (format == "ppm" || format == "pam") {
+        writer.reset(new NetpbmWriter(format == "pam"));
+    } else {
+        if (format != "png" && normalizedPath != "-") {
+            // Default to PNG if extension is unsupported
+            outputPath = normalizedPath + ".png";
+            std::cout << "Unsupported extension, saving as PNG: " << outputPath << std::endl;
+        }
+        PngWriter* pngWriter = new PngWriter(Utils::ProgramOptions::pngCompressionLevel, Utils::ProgramOptions::threads);
+        if (!palette.empty()) {
+            pngWriter->setPalette(palette);
+        }
+        writer.reset(pngWriter);
+    }
+
+    bool success;
+    {
+        // Scanline rendering is timed as a separate phase nested inside encoding. A phase per
+        // row would cost more than rendering small rows, so the rows' time is summed here;
+        // rendering runs on this thread only, so its CPU time is its wall time.
+        Stats::ScopedPhase encodePhase("encode");
+        success = writer->begin(outputPath, width, height);
+        std::chrono::steady_clock::duration renderTime(0);
+        for (int y = 0; success && y < height; ++y) {
+            auto renderStart = std::chrono::steady_clock::now();
+            const RGB* row = rowSource(y);
+            renderTime += std::chrono::steady_clock::now() - renderStart;
+            success = writer->writeRow(row);
+        }
+        success = writer->finish() && success;
+
+        double renderMs = std::chrono::duration<double, std::milli>(renderTime).count();
+        Stats::addPhaseTime("render", renderMs, renderMs);
+        encodePhase.exclude(renderMs, renderMs);
+    }
+
+    if (success) {
+        std::cout << "Successfully saved image to: " << normalizedPath << std::endl;
+    } else {
+        std::cerr << "Error: Failed to save image to: " << normalizedPath << std::endl;
+    }
+
+    return success;
 }
\ No newline at end of file
@@ -0,0 +1,427 @@
+#include "JpegWriter.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <thread>
+
+// Encoding follows stb_image_write's JPEG writer (itself based on Jon Olick's jo_jpeg),
+// restructured to consume one MCU row at a time and to code MCU rows as restart intervals.
+
+namespace {
+    const uint8_t ZIGZAG[64] = {0, 1, 5, 6, 14, 15, 27, 28, 2, 4, 7, 13, 16, 26, 29, 42, 3, 8, 12, 17, 25, 30, 41, 43,
+                                9, 11, 18, 24, 31, 40, 44, 53, 10, 19, 23, 32, 39, 45, 52, 54, 20, 22, 33, 38, 46, 51,
+                                55, 60, 21, 34, 37, 47, 50, 56, 59, 61, 35, 36, 48, 49, 57, 58, 62, 63};
+
+    const uint8_t DC_LUMINANCE_COUNTS[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+    const uint8_t DC_LUMINANCE_VALUES[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+    const uint8_t AC_LUMINANCE_COUNTS[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+    const uint8_t AC_LUMINANCE_VALUES[162] = {
+        0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71,
+        0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72,
+        0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37,
+        0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+        0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83,
+        0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3,
+        0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+        0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+        0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+    const uint8_t DC_CHROMINANCE_COUNTS[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+    const uint8_t DC_CHROMINANCE_VALUES[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+    const uint8_t AC_CHROMINANCE_COUNTS[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+    const uint8_t AC_CHROMINANCE_VALUES[162] = {
+        0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22,
+        0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1,
+        0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36,
+        0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+        0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a,
+        0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a,
+        0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba,
+        0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+        0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+
+    const int Y_QUANT[64] = {16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55, 14, 13, 16, 24, 40, 57,
+                             69, 56, 14, 17, 22, 29, 51, 87, 80, 62, 18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64,
+                             81, 104, 113, 92, 49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99};
+    const int UV_QUANT[64] = {17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99, 24, 26, 56, 99, 99, 99,
+                              99, 99, 47, 66, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+                              99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99};
+    const float AAN_SCALE[8] = {1.0f * 2.828427125f, 1.387039845f * 2.828427125f, 1.306562965f * 2.828427125f,
+                                1.175875602f * 2.828427125f, 1.0f * 2.828427125f, 0.785694958f * 2.828427125f,
+                                0.541196100f * 2.828427125f, 0.275899379f * 2.828427125f};
+
+    struct HuffmanCode {
+        uint16_t code;
+        uint8_t length;
+    };
+
+    // Canonical Huffman codes (JPEG Annex C) derived from the standard tables
+    struct HuffmanTables {
+        HuffmanCode yDC[256], yAC[256], uvDC[256], uvAC[256];
+
+        HuffmanTables() {
+            build(DC_LUMINANCE_COUNTS, DC_LUMINANCE_VALUES, yDC);
+            build(AC_LUMINANCE_COUNTS, AC_LUMINANCE_VALUES, yAC);
+            build(DC_CHROMINANCE_COUNTS, DC_CHROMINANCE_VALUES, uvDC);
+            build(AC_CHROMINANCE_COUNTS, AC_CHROMINANCE_VALUES, uvAC);
+        }
+
+        static void build(const uint8_t* counts, const uint8_t* values, HuffmanCode* table) {
+            for (int i = 0; i < 256; ++i) table[i] = {0, 0};
+            uint16_t code = 0;
+            int k = 0;
+            for (int length = 1; length <= 16; ++length) {
+                for (int i = 0; i < counts[length - 1]; ++i) {
+                    table[values[k++]] = {code++, static_cast<uint8_t>(length)};
+                }
+                code <<= 1;
+            }
+        }
+    };
+
+    const HuffmanTables& huffman() {
+        static const HuffmanTables instance;
+        return instance;
+    }
+
+    void forwardDCT(float* d0p, float* d1p, float* d2p, float* d3p, float* d4p, float* d5p, float* d6p, float* d7p) {
+        float d0 = *d0p, d1 = *d1p, d2 = *d2p, d3 = *d3p, d4 = *d4p, d5 = *d5p, d6 = *d6p, d7 = *d7p;
+
+        float tmp0 = d0 + d7;
+        float tmp7 = d0 - d7;
+        float tmp1 = d1 + d6;
+        float tmp6 = d1 - d6;
+        float tmp2 = d2 + d5;
+        float tmp5 = d2 - d5;
+        float tmp3 = d3 + d4;
+        float tmp4 = d3 - d4;
+
+        // Even part
+        float tmp10 = tmp0 + tmp3;
+        float tmp13 = tmp0 - tmp3;
+        float tmp11 = tmp1 + tmp2;
+        float tmp12 = tmp1 - tmp2;
+
+        d0 = tmp10 + tmp11;
+        d4 = tmp10 - tmp11;
+
+        float z1 = (tmp12 + tmp13) * 0.707106781f;
+        d2 = tmp13 + z1;
+        d6 = tmp13 - z1;
+
+        // Odd part
+        tmp10 = tmp4 + tmp5;
+        tmp11 = tmp5 + tmp6;
+        tmp12 = tmp6 + tmp7;
+
+        float z5 = (tmp10 - tmp12) * 0.382683433f;
+        float z2 = tmp10 * 0.541196100f + z5;
+        float z4 = tmp12 * 1.306562965f + z5;
+        float z3 = tmp11 * 0.707106781f;
+
+        float z11 = tmp7 + z3;
+        float z13 = tmp7 - z3;
+
+        *d5p = z13 + z2;
+        *d3p = z13 - z2;
+        *d1p = z11 + z4;
+        *d7p = z11 - z4;
+
+        *d0p = d0;
+        *d2p = d2;
+        *d4p = d4;
+        *d6p = d6;
+    }
+
+    // Magnitude category and value bits of a coefficient
+    void calculateBits(int value, uint16_t& bits, int& length) {
+        int magnitude = value < 0 ? -value : value;
+        value = value < 0 ? value - 1 : value;
+        length = 1;
+        while (magnitude >>= 1) ++length;
+        bits = static_cast<uint16_t>(value & ((1 << length) - 1));
+    }
+}
+
+JpegWriter::JpegWriter(int quality, unsigned int threads)
+    : quality(quality), threadCount(threads), width(0), height(0), rowsWritten(0), subsample(true), mcuSize(16),
+      pendingStripes(0), stripeRows(0), mcuRowsWritten(0) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+bool JpegWriter::begin(const std::string& filename, int width, int height) {
+    if (width <= 0 || height <= 0 || width > 65535 || height > 65535) return false;
+
+    if (!openOutput(filename)) return false;
+
+    this->width = width;
+    this->height = height;
+    rowsWritten = 0;
+
+    int q = quality ? quality : 90;
+    subsample = q <= 90;
+    mcuSize = subsample ? 16 : 8;
+    q = std::max(1, std::min(100, q));
+    q = q < 50 ? 5000 / q : 200 - q * 2;
+
+    uint8_t yTable[64], uvTable[64];
+    for (int i = 0; i < 64; ++i) {
+        int yti = (Y_QUANT[i] * q + 50) / 100;
+        int uvti = (UV_QUANT[i] * q + 50) / 100;
+        yTable[ZIGZAG[i]] = static_cast<uint8_t>(std::max(1, std::min(255, yti)));
+        uvTable[ZIGZAG[i]] = static_cast<uint8_t>(std::max(1, std::min(255, uvti)));
+    }
+    for (int row = 0, k = 0; row < 8; ++row) {
+        for (int col = 0; col < 8; ++col, ++k) {
+            fdtblY[k] = 1 / (yTable[ZIGZAG[k]] * AAN_SCALE[row] * AAN_SCALE[col]);
+            fdtblUV[k] = 1 / (uvTable[ZIGZAG[k]] * AAN_SCALE[row] * AAN_SCALE[col]);
+        }
+    }
+
+    stripes.assign(threadCount, std::vector<RGB>(static_cast<size_t>(width) * mcuSize));
+    pendingStripes = 0;
+    stripeRows = 0;
+    mcuRowsWritten = 0;
+
+    writeHeaders(yTable, uvTable);
+    return file->good();
+}
+
+bool JpegWriter::writeRow(const RGB* row) {
+    if (!file || rowsWritten >= height) return false;
+
+    std::vector<RGB>& stripe = stripes[pendingStripes];
+    std::copy(row, row + width, stripe.begin() + static_cast<size_t>(stripeRows) * width);
+    ++stripeRows;
+    ++rowsWritten;
+
+    if (stripeRows == mcuSize || rowsWritten == height) {
+        // Rows past the bottom edge repeat the last image row
+        for (int r = stripeRows; r < mcuSize; ++r) {
+            std::copy(stripe.begin() + static_cast<size_t>(stripeRows - 1) * width,
+                      stripe.begin() + static_cast<size_t>(stripeRows) * width,
+                      stripe.begin() + static_cast<size_t>(r) * width);
+        }
+        stripeRows = 0;
+        ++pendingStripes;
+
+        if (pendingStripes == stripes.size() || rowsWritten == height) {
+            flushStripes();
+        }
+    }
+    return file->good();
+}
+
+bool JpegWriter::finish() {
+    if (!file) return false;
+
+    bool complete = rowsWritten == height;
+
+    static const uint8_t endOfImage[] = {0xFF, 0xD9};
+    file->write(reinterpret_cast<const char*>(endOfImage), sizeof(endOfImage));
+
+    return closeOutput() && complete;
+}
+
+void JpegWriter::writeHeaders(const uint8_t* yTable, const uint8_t* uvTable) {
+    static const uint8_t head0[] = {0xFF, 0xD8, 0xFF, 0xE0, 0, 0x10, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0,
+                                    0xFF, 0xDB, 0, 0x84, 0};
+    static const uint8_t head2[] = {0xFF, 0xDA, 0, 0xC, 3, 1, 0, 2, 0x11, 3, 0x11, 0, 0x3F, 0};
+    const uint8_t head1[] = {0xFF, 0xC0, 0, 0x11, 8,
+                             static_cast<uint8_t>(height >> 8), static_cast<uint8_t>(height),
+                             static_cast<uint8_t>(width >> 8), static_cast<uint8_t>(width),
+                             3, 1, static_cast<uint8_t>(subsample ? 0x22 : 0x11), 0, 2, 0x11, 1, 3, 0x11, 1,
+                             0xFF, 0xC4, 0x01, 0xA2, 0};
+
+    // Restart interval of one MCU row
+    int mcusPerRow = (width + mcuSize - 1) / mcuSize;
+    const uint8_t restartInterval[] = {0xFF, 0xDD, 0, 4,
+                                       static_cast<uint8_t>(mcusPerRow >> 8), static_cast<uint8_t>(mcusPerRow)};
+
+    std::vector<uint8_t> output;
+    output.insert(output.end(), head0, head0 + sizeof(head0));
+    output.insert(output.end(), yTable, yTable + 64);
+    output.push_back(1);
+    output.insert(output.end(), uvTable, uvTable + 64);
+    output.insert(output.end(), head1, head1 + sizeof(head1));
+    output.insert(output.end(), DC_LUMINANCE_COUNTS, DC_LUMINANCE_COUNTS + 16);
+    output.insert(output.end(), DC_LUMINANCE_VALUES, DC_LUMINANCE_VALUES + 12);
+    output.push_back(0x10);
+    output.insert(output.end(), AC_LUMINANCE_COUNTS, AC_LUMINANCE_COUNTS + 16);
+    output.insert(output.end(), AC_LUMINANCE_VALUES, AC_LUMINANCE_VALUES + 162);
+    output.push_back(1);
+    output.insert(output.end(), DC_CHROMINANCE_COUNTS, DC_CHROMINANCE_COUNTS + 16);
+    output.insert(output.end(), DC_CHROMINANCE_VALUES, DC_CHROMINANCE_VALUES + 12);
+    output.push_back(0x11);
+    output.insert(output.end(), AC_CHROMINANCE_COUNTS, AC_CHROMINANCE_COUNTS + 16);
+    output.insert(output.end(), AC_CHROMINANCE_VALUES, AC_CHROMINANCE_VALUES + 162);
+    output.insert(output.end(), restartInterval, restartInterval + sizeof(restartInterval));
+    output.insert(output.end(), head2, head2 + sizeof(head2));
+
+    file->write(reinterpret_cast<const char*>(output.data()), output.size());
+}
+
+void JpegWriter::flushStripes() {
+    std::vector<Segment> segments(pendingStripes);
+
+    auto encode = [this, &segments](size_t i) {
+        Trace::Scope trace("jpeg stripe", "encode");
+        trace.arg("mcu_row", mcuRowsWritten + static_cast<long long>(i));
+        encodeStripe(stripes[i], segments[i]);
+    };
+
+    if (pendingStripes == 1) {
+        encode(0);
+    } else {
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < pendingStripes; ++i) {
+            workers.emplace_back([&encode, i]() {
+                Trace::setThreadName("jpeg worker");
+                encode(i);
+            });
+        }
+        encode(0);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    int totalMcuRows = (height + mcuSize - 1) / mcuSize;
+    for (size_t i = 0; i < pendingStripes; ++i) {
+        file->write(reinterpret_cast<const char*>(segments[i].bytes.data()), segments[i].bytes.size());
+        ++mcuRowsWritten;
+        if (mcuRowsWritten < totalMcuRows) {
+            const uint8_t marker[] = {0xFF, static_cast<uint8_t>(0xD0 + ((mcuRowsWritten - 1) & 7))};
+            file->write(reinterpret_cast<const char*>(marker), sizeof(marker));
+        }
+    }
+    pendingStripes = 0;
+}
+
+void JpegWriter::encodeStripe(const std::vector<RGB>& pixels, Segment& segment) const {
+    segment.bytes.clear();
+    segment.bitBuffer = 0;
+    segment.bitCount = 0;
+
+    // DC predictors restart at zero in every restart interval
+    int dcY = 0, dcU = 0, dcV = 0;
+
+    const int blockSize = mcuSize;
+    for (int x = 0; x < width; x += blockSize) {
+        float Y[256], U[256], V[256];
+        for (int row = 0, pos = 0; row < blockSize; ++row) {
+            const RGB* line = &pixels[static_cast<size_t>(row) * width];
+            for (int col = x; col < x + blockSize; ++col, ++pos) {
+                // Columns past the right edge repeat the last pixel
+                const RGB& p = line[col < width ? col : width - 1];
+                float r = p.r, g = p.g, b = p.b;
+                Y[pos] = +0.29900f * r + 0.58700f * g + 0.11400f * b - 128;
+                U[pos] = -0.16874f * r - 0.33126f * g + 0.50000f * b;
+                V[pos] = +0.50000f * r - 0.41869f * g - 0.08131f * b;
+            }
+        }
+
+        if (subsample) {
+            dcY = processDU(segment, Y + 0, 16, fdtblY, dcY, false);
+            dcY = processDU(segment, Y + 8, 16, fdtblY, dcY, false);
+            dcY = processDU(segment, Y + 128, 16, fdtblY, dcY, false);
+            dcY = processDU(segment, Y + 136, 16, fdtblY, dcY, false);
+
+            float subU[64], subV[64];
+            for (int yy = 0, pos = 0; yy < 8; ++yy) {
+                for (int xx = 0; xx < 8; ++xx, ++pos) {
+                    int j = yy * 32 + xx * 2;
+                    subU[pos] = (U[j] + U[j + 1] + U[j + 16] + U[j + 17]) * 0.25f;
+                    subV[pos] = (V[j] + V[j + 1] + V[j + 16] + V[j + 17]) * 0.25f;
+                }
+            }
+            dcU = processDU(segment, subU, 8, fdtblUV, dcU, true);
+            dcV = processDU(segment, subV, 8, fdtblUV, dcV, true);
+        } else {
+            dcY = processDU(segment, Y, 8, fdtblY, dcY, false);
+            dcU = processDU(segment, U, 8, fdtblUV, dcU, true);
+            dcV = processDU(segment, V, 8, fdtblUV, dcV, true);
+        }
+    }
+
+    // Pad the final byte of the interval with 1-bits
+    writeBits(segment, 0x7F, 7);
+}
+
+int JpegWriter::processDU(Segment& segment, float* cdu, int stride, const float* fdtbl, int dc, bool chroma) const {
+    const HuffmanCode* dcTable = chroma ? huffman().uvDC : huffman().yDC;
+    const HuffmanCode* acTable = chroma ? huffman().uvAC : huffman().yAC;
+    int du[64];
+
+    // DCT rows, then columns
+    for (int offset = 0; offset < stride * 8; offset += stride) {
+        forwardDCT(&cdu[offset], &cdu[offset + 1], &cdu[offset + 2], &cdu[offset + 3],
+                   &cdu[offset + 4], &cdu[offset + 5], &cdu[offset + 6], &cdu[offset + 7]);
+    }
+    for (int offset = 0; offset < 8; ++offset) {
+        forwardDCT(&cdu[offset], &cdu[offset + stride], &cdu[offset + stride * 2], &cdu[offset + stride * 3],
+                   &cdu[offset + stride * 4], &cdu[offset + stride * 5], &cdu[offset + stride * 6],
+                   &cdu[offset + stride * 7]);
+    }
+
+    // Quantize, descale and zigzag the coefficients
+    for (int y = 0, j = 0; y < 8; ++y) {
+        for (int x = 0; x < 8; ++x, ++j) {
+            float v = cdu[y * stride + x] * fdtbl[j];
+            du[ZIGZAG[j]] = static_cast<int>(v < 0 ? v - 0.5f : v + 0.5f);
+        }
+    }
+
+    uint16_t bits;
+    int length;
+
+    // DC coefficient as a difference from the previous block
+    int diff = du[0] - dc;
+    if (diff == 0) {
+        writeBits(segment, dcTable[0].code, dcTable[0].length);
+    } else {
+        calculateBits(diff, bits, length);
+        writeBits(segment, dcTable[length].code, dcTable[length].length);
+        writeBits(segment, bits, length);
+    }
+
+    // AC coefficients as (zero run, magnitude) pairs
+    int end0pos = 63;
+    while (end0pos > 0 && du[end0pos] == 0) --end0pos;
+    if (end0pos == 0) {
+        writeBits(segment, acTable[0x00].code, acTable[0x00].length);
+        return du[0];
+    }
+    for (int i = 1; i <= end0pos; ++i) {
+        int start = i;
+        while (du[i] == 0 && i <= end0pos) ++i;
+        int zeroes = i - start;
+        if (zeroes >= 16) {
+            for (int marker = 1; marker <= (zeroes >> 4); ++marker) {
+                writeBits(segment, acTable[0xF0].code, acTable[0xF0].length);
+            }
+            zeroes &= 15;
+        }
+        calculateBits(du[i], bits, length);
+        writeBits(segment, acTable[(zeroes << 4) + length].code, acTable[(zeroes << 4) + length].length);
+        writeBits(segment, bits, length);
+    }
+    if (end0pos != 63) {
+        writeBits(segment, acTable[0x00].code, acTable[0x00].length);
+    }
+    return du[0];
+}
+
+void JpegWriter::writeBits(Segment& segment, uint16_t code, int length) {
+    segment.bitCount += length;
+    segment.bitBuffer |= static_cast<uint32_t>(code) << (24 - segment.bitCount);
+    while (segment.bitCount >= 8) {
+        uint8_t c = static_cast<uint8_t>((segment.bitBuffer >> 16) & 255);
+        segment.bytes.push_back(c);
+        if (c == 255) {
+            segment.bytes.push_back(0);  // byte stuffing
+        }
+        segment.bitBuffer <<= 8;
+        segment.bitCount -= 8;
+    }
+}
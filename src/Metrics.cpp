@@ -0,0 +1,303 @@
+#include "Metrics.hpp"
+#include "Stats.hpp"
+#include <map>
+#include <mutex>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#endif
+
+namespace {
+    // Upper bounds of the build latency histogram in seconds; +Inf is implied
+    const double BUILD_BUCKETS[] = {0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30};
+    const int BUILD_BUCKET_COUNT = sizeof(BUILD_BUCKETS) / sizeof(BUILD_BUCKETS[0]);
+
+    struct MethodMetrics {
+        double images = 0;
+        double buildSecondsSum = 0;
+        double buckets[BUILD_BUCKET_COUNT + 1] = {};  // Non-cumulative; the last one is +Inf
+    };
+
+    struct Snapshot {
+        std::map<std::string, MethodMetrics> methods;
+        std::map<std::string, double> errors;
+        std::map<std::string, double> phaseSeconds;
+        double inputBytes = 0;
+        double outputBytes = 0;
+        double queueDepth = 0;
+    };
+
+    struct Registry {
+        std::mutex mutex;
+        Snapshot totals;
+    };
+
+    Registry& registry() {
+        static Registry instance;
+        return instance;
+    }
+
+    // Current totals, with the Stats phases converted to seconds
+    Snapshot currentSnapshot() {
+        Registry& metrics = registry();
+        Snapshot snapshot;
+        {
+            std::lock_guard<std::mutex> lock(metrics.mutex);
+            snapshot = metrics.totals;
+        }
+        for (const Stats::Phase& phase : Stats::getPhases()) {
+            snapshot.phaseSeconds[phase.name] += phase.wallMs / 1000.0;
+        }
+        return snapshot;
+    }
+
+    std::string formatBound(double bound) {
+        std::ostringstream text;
+        text << bound;
+        return text.str();
+    }
+
+    std::string escapeLabel(const std::string& value) {
+        std::string escaped;
+        for (char c : value) {
+            if (c == '\\' || c == '"') escaped += '\\';
+            if (c == '\n') {
+                escaped += "\\n";
+                continue;
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    // Parses name{key="value",...} into the name and its labels
+    bool parseSeries(const std::string& series, std::string& name, std::map<std::string, std::string>& labels) {
+        size_t brace = series.find('{');
+        name = series.substr(0, brace);
+        if (brace == std::string::npos) return true;
+
+        size_t pos = brace + 1;
+        while (pos < series.size() && series[pos] != '}') {
+            size_t equals = series.find('=', pos);
+            if (equals == std::string::npos || equals + 1 >= series.size() || series[equals + 1] != '"') return false;
+            std::string key = series.substr(pos, equals - pos);
+            std::string value;
+            size_t i = equals + 2;
+            for (; i < series.size() && series[i] != '"'; ++i) {
+                if (series[i] == '\\' && i + 1 < series.size()) {
+                    ++i;
+                    value += series[i] == 'n' ? '\n' : series[i];
+                } else {
+                    value += series[i];
+                }
+            }
+            labels[key] = value;
+            pos = i + 1;
+            if (pos < series.size() && series[pos] == ',') ++pos;
+        }
+        return true;
+    }
+
+    // Reads a file written by writeSnapshot; unknown series are ignored
+    void readSnapshot(const std::string& filename, Snapshot& snapshot) {
+        std::ifstream file(filename);
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            size_t space = line.rfind(' ');
+            if (space == std::string::npos) continue;
+
+            std::string name;
+            std::map<std::string, std::string> labels;
+            if (!parseSeries(line.substr(0, space), name, labels)) continue;
+            double value = std::atof(line.c_str() + space + 1);
+
+            if (name == "quadtree_images_processed_total") {
+                snapshot.methods[labels["method"]].images = value;
+            } else if (name == "quadtree_build_seconds_sum") {
+                snapshot.methods[labels["method"]].buildSecondsSum = value;
+            } else if (name == "quadtree_build_seconds_bucket") {
+                // Cumulative in the file; converted back to per-bucket counts once all are read
+                MethodMetrics& method = snapshot.methods[labels["method"]];
+                const std::string& le = labels["le"];
+                for (int i = 0; i <= BUILD_BUCKET_COUNT; ++i) {
+                    if (le == (i < BUILD_BUCKET_COUNT ? formatBound(BUILD_BUCKETS[i]) : "+Inf")) {
+                        method.buckets[i] = value;
+                    }
+                }
+            } else if (name == "quadtree_input_bytes_total") {
+                snapshot.inputBytes = value;
+            } else if (name == "quadtree_output_bytes_total") {
+                snapshot.outputBytes = value;
+            } else if (name == "quadtree_errors_total") {
+                snapshot.errors[labels["stage"]] = value;
+            } else if (name == "quadtree_phase_seconds_total") {
+                snapshot.phaseSeconds[labels["phase"]] = value;
+            }
+        }
+
+        for (auto& method : snapshot.methods) {
+            for (int i = BUILD_BUCKET_COUNT; i > 0; --i) {
+                method.second.buckets[i] -= method.second.buckets[i - 1];
+            }
+        }
+    }
+
+    void addSnapshot(Snapshot& total, const Snapshot& added) {
+        for (const auto& entry : added.methods) {
+            MethodMetrics& method = total.methods[entry.first];
+            method.images += entry.second.images;
+            method.buildSecondsSum += entry.second.buildSecondsSum;
+            for (int i = 0; i <= BUILD_BUCKET_COUNT; ++i) {
+                method.buckets[i] += entry.second.buckets[i];
+            }
+        }
+        for (const auto& entry : added.errors) total.errors[entry.first] += entry.second;
+        for (const auto& entry : added.phaseSeconds) total.phaseSeconds[entry.first] += entry.second;
+        total.inputBytes += added.inputBytes;
+        total.outputBytes += added.outputBytes;
+        total.queueDepth = added.queueDepth;  // Gauge: the latest value wins
+    }
+
+    bool writeSnapshot(const std::string& filename, const Snapshot& snapshot) {
+        std::ostringstream temporaryName;
+#ifdef _WIN32
+        temporaryName << filename << ".tmp";
+#else
+        temporaryName << filename << ".tmp." << getpid();
+#endif
+        std::string temporary = temporaryName.str();
+        {
+            std::ofstream file(temporary);
+            if (!file.is_open()) return false;
+            file << std::setprecision(15);
+
+            file << "# HELP quadtree_images_processed_total Images compressed.\n"
+                 << "# TYPE quadtree_images_processed_total counter\n";
+            for (const auto& method : snapshot.methods) {
+                file << "quadtree_images_processed_total{method=\"" << escapeLabel(method.first) << "\"} "
+                     << method.second.images << "\n";
+            }
+
+            file << "# HELP quadtree_build_seconds Quadtree build time per image.\n"
+                 << "# TYPE quadtree_build_seconds histogram\n";
+            for (const auto& method : snapshot.methods) {
+                std::string label = escapeLabel(method.first);
+                double cumulative = 0;
+                for (int i = 0; i <= BUILD_BUCKET_COUNT; ++i) {
+                    cumulative += method.second.buckets[i];
+                    file << "quadtree_build_seconds_bucket{method=\"" << label << "\",le=\""
+                         << (i < BUILD_BUCKET_COUNT ? formatBound(BUILD_BUCKETS[i]) : "+Inf") << "\"} "
+                         << cumulative << "\n";
+                }
+                file << "quadtree_build_seconds_sum{method=\"" << label << "\"} " << method.second.buildSecondsSum << "\n";
+                file << "quadtree_build_seconds_count{method=\"" << label << "\"} " << cumulative << "\n";
+            }
+
+            file << "# HELP quadtree_input_bytes_total Bytes of input image files.\n"
+                 << "# TYPE quadtree_input_bytes_total counter\n"
+                 << "quadtree_input_bytes_total " << snapshot.inputBytes << "\n";
+            file << "# HELP quadtree_output_bytes_total Bytes of output image files.\n"
+                 << "# TYPE quadtree_output_bytes_total counter\n"
+                 << "quadtree_output_bytes_total " << snapshot.outputBytes << "\n";
+
+            file << "# HELP quadtree_errors_total Failed requests by stage.\n"
+                 << "# TYPE quadtree_errors_total counter\n";
+            for (const auto& error : snapshot.errors) {
+                file << "quadtree_errors_total{stage=\"" << escapeLabel(error.first) << "\"} " << error.second << "\n";
+            }
+
+            file << "# HELP quadtree_phase_seconds_total Wall time per program phase, as in --stats-json.\n"
+                 << "# TYPE quadtree_phase_seconds_total counter\n";
+            for (const auto& phase : snapshot.phaseSeconds) {
+                file << "quadtree_phase_seconds_total{phase=\"" << escapeLabel(phase.first) << "\"} "
+                     << phase.second << "\n";
+            }
+
+            file << "# HELP quadtree_queue_depth Requests waiting to be processed.\n"
+                 << "# TYPE quadtree_queue_depth gauge\n"
+                 << "quadtree_queue_depth " << snapshot.queueDepth << "\n";
+
+            if (!file.good()) {
+                file.close();
+                std::remove(temporary.c_str());
+                return false;
+            }
+        }
+
+#ifdef _WIN32
+        std::remove(filename.c_str());  // rename does not replace existing files on Windows
+#endif
+        if (std::rename(temporary.c_str(), filename.c_str()) != 0) {
+            std::remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+}
+
+namespace Metrics {
+    void recordImage(const std::string& errorMethod, long long inputBytes, long long outputBytes,
+                     double buildSeconds) {
+        Registry& metrics = registry();
+        std::lock_guard<std::mutex> lock(metrics.mutex);
+        MethodMetrics& method = metrics.totals.methods[errorMethod];
+        method.images += 1;
+        method.buildSecondsSum += buildSeconds;
+
+        int bucket = 0;
+        while (bucket < BUILD_BUCKET_COUNT && buildSeconds > BUILD_BUCKETS[bucket]) {
+            ++bucket;
+        }
+        method.buckets[bucket] += 1;
+
+        metrics.totals.inputBytes += inputBytes;
+        metrics.totals.outputBytes += outputBytes;
+    }
+
+    void recordError(const std::string& stage) {
+        Registry& metrics = registry();
+        std::lock_guard<std::mutex> lock(metrics.mutex);
+        metrics.totals.errors[stage] += 1;
+    }
+
+    void setQueueDepth(long long depth) {
+        Registry& metrics = registry();
+        std::lock_guard<std::mutex> lock(metrics.mutex);
+        metrics.totals.queueDepth = static_cast<double>(depth);
+    }
+
+    bool writeTextfile(const std::string& filename) {
+        return writeSnapshot(filename, currentSnapshot());
+    }
+
+    bool mergeIntoTextfile(const std::string& filename) {
+#ifndef _WIN32
+        // Serializes concurrent invocations so none of their increments are lost
+        std::string lockPath = filename + ".lock";
+        int lockFile = open(lockPath.c_str(), O_CREAT | O_RDWR, 0644);
+        if (lockFile >= 0) flock(lockFile, LOCK_EX);
+#endif
+
+        Snapshot total;
+        readSnapshot(filename, total);
+        addSnapshot(total, currentSnapshot());
+        bool written = writeSnapshot(filename, total);
+
+#ifndef _WIN32
+        if (lockFile >= 0) {
+            flock(lockFile, LOCK_UN);
+            close(lockFile);
+        }
+#endif
+        return written;
+    }
+}
@@ -0,0 +1,42 @@
+#include "NetpbmWriter.hpp"
+#include <sstream>
+
+static_assert(sizeof(RGB) == 3, "rows are written as packed RGB triples");
+
+NetpbmWriter::NetpbmWriter(bool pam)
+    : pam(pam), width(0), height(0), rowsWritten(0) {
+}
+
+bool NetpbmWriter::begin(const std::string& filename, int width, int height) {
+    if (width <= 0 || height <= 0) return false;
+    if (!openOutput(filename)) return false;
+
+    this->width = width;
+    this->height = height;
+    rowsWritten = 0;
+
+    std::ostringstream header;
+    if (pam) {
+        header << "P7\nWIDTH " << width << "\nHEIGHT " << height
+               << "\nDEPTH 3\nMAXVAL 255\nTUPLTYPE RGB\nENDHDR\n";
+    } else {
+        header << "P6\n" << width << " " << height << "\n255\n";
+    }
+    *file << header.str();
+    return file->good();
+}
+
+bool NetpbmWriter::writeRow(const RGB* row) {
+    if (!file || rowsWritten >= height) return false;
+
+    file->write(reinterpret_cast<const char*>(row), static_cast<std::streamsize>(width) * 3);
+    ++rowsWritten;
+    return file->good();
+}
+
+bool NetpbmWriter::finish() {
+    if (!file) return false;
+
+    bool complete = rowsWritten == height;
+    return closeOutput() && complete;
+}
@@ -0,0 +1,159 @@
+#include "Palette.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+    void collectRecursive(const QuadTreeNode* node,
+                          std::unordered_map<uint32_t, size_t>& indexByColor,
+                          std::vector<Palette::Entry>& colors,
+                          size_t limit) {
+        if (!node || (limit > 0 && colors.size() > limit)) return;
+
+        if (node->isNodeLeaf()) {
+            RGB color = node->getAverageColor();
+            long long area = static_cast<long long>(node->getBlockWidth()) * node->getBlockHeight();
+            auto inserted = indexByColor.insert(std::make_pair(Palette::packColor(color), colors.size()));
+            if (inserted.second) {
+                colors.push_back({color, area});
+            } else {
+                colors[inserted.first->second].weight += area;
+            }
+            return;
+        }
+        for (int i = 0; i < 4; ++i) {
+            collectRecursive(node->getChildAt(i), indexByColor, colors, limit);
+        }
+    }
+
+    uint8_t channel(const RGB& color, int axis) {
+        return axis == 0 ? color.r : (axis == 1 ? color.g : color.b);
+    }
+
+    // A box of the color cube holding the range [begin, end) of the color list
+    struct Box {
+        size_t begin, end;
+        int axis;
+        int range;
+    };
+
+    Box makeBox(const std::vector<Palette::Entry>& colors, size_t begin, size_t end) {
+        int minC[3] = {255, 255, 255}, maxC[3] = {0, 0, 0};
+        for (size_t i = begin; i < end; ++i) {
+            for (int axis = 0; axis < 3; ++axis) {
+                int value = channel(colors[i].color, axis);
+                minC[axis] = std::min(minC[axis], value);
+                maxC[axis] = std::max(maxC[axis], value);
+            }
+        }
+        Box box = {begin, end, 0, -1};
+        for (int axis = 0; axis < 3; ++axis) {
+            if (maxC[axis] - minC[axis] > box.range) {
+                box.range = maxC[axis] - minC[axis];
+                box.axis = axis;
+            }
+        }
+        return box;
+    }
+}
+
+namespace Palette {
+    std::vector<Entry> collectLeafColors(const QuadTree& tree, size_t limit) {
+        std::unordered_map<uint32_t, size_t> indexByColor;
+        std::vector<Entry> colors;
+        collectRecursive(tree.getRoot(), indexByColor, colors, limit);
+        return colors;
+    }
+
+    std::vector<Entry> collectImageColors(const std::vector<std::vector<RGB>>& image) {
+        const int BUCKETS = 32 * 32 * 32;
+        std::vector<long long> count(BUCKETS), sumR(BUCKETS), sumG(BUCKETS), sumB(BUCKETS);
+        for (const std::vector<RGB>& row : image) {
+            for (const RGB& pixel : row) {
+                int bucket = ((pixel.r >> 3) << 10) | ((pixel.g >> 3) << 5) | (pixel.b >> 3);
+                ++count[bucket];
+                sumR[bucket] += pixel.r;
+                sumG[bucket] += pixel.g;
+                sumB[bucket] += pixel.b;
+            }
+        }
+
+        std::vector<Entry> colors;
+        for (int bucket = 0; bucket < BUCKETS; ++bucket) {
+            long long n = count[bucket];
+            if (n == 0) continue;
+            colors.push_back({{static_cast<uint8_t>((sumR[bucket] + n / 2) / n),
+                               static_cast<uint8_t>((sumG[bucket] + n / 2) / n),
+                               static_cast<uint8_t>((sumB[bucket] + n / 2) / n)}, n});
+        }
+        return colors;
+    }
+
+    std::vector<RGB> medianCut(std::vector<Entry> colors, size_t maxColors) {
+        std::vector<RGB> palette;
+        if (colors.empty() || maxColors == 0) return palette;
+
+        std::vector<Box> boxes;
+        boxes.push_back(makeBox(colors, 0, colors.size()));
+
+        // Repeatedly split the box with the widest channel range at its weighted median
+        while (boxes.size() < maxColors) {
+            size_t widest = 0;
+            for (size_t i = 1; i < boxes.size(); ++i) {
+                if (boxes[i].range > boxes[widest].range) widest = i;
+            }
+            Box box = boxes[widest];
+            if (box.range <= 0 || box.end - box.begin < 2) break;
+
+            int axis = box.axis;
+            std::sort(colors.begin() + box.begin, colors.begin() + box.end,
+                      [axis](const Entry& a, const Entry& b) { return channel(a.color, axis) < channel(b.color, axis); });
+
+            long long total = 0;
+            for (size_t i = box.begin; i < box.end; ++i) total += colors[i].weight;
+
+            size_t split = box.begin + 1;
+            long long running = colors[box.begin].weight;
+            while (split < box.end - 1 && running * 2 < total) {
+                running += colors[split].weight;
+                ++split;
+            }
+
+            boxes[widest] = makeBox(colors, box.begin, split);
+            boxes.push_back(makeBox(colors, split, box.end));
+        }
+
+        // Each box contributes its weighted average color
+        for (const Box& box : boxes) {
+            double sumR = 0, sumG = 0, sumB = 0, total = 0;
+            for (size_t i = box.begin; i < box.end; ++i) {
+                double w = static_cast<double>(colors[i].weight);
+                sumR += colors[i].color.r * w;
+                sumG += colors[i].color.g * w;
+                sumB += colors[i].color.b * w;
+                total += w;
+            }
+            if (total <= 0) total = 1;
+            palette.push_back({static_cast<uint8_t>(sumR / total + 0.5),
+                               static_cast<uint8_t>(sumG / total + 0.5),
+                               static_cast<uint8_t>(sumB / total + 0.5)});
+        }
+        return palette;
+    }
+
+    int nearestIndex(const std::vector<RGB>& palette, const RGB& color) {
+        int best = 0;
+        int bestDistance = -1;
+        for (size_t i = 0; i < palette.size(); ++i) {
+            int dr = palette[i].r - color.r;
+            int dg = palette[i].g - color.g;
+            int db = palette[i].b - color.b;
+            int distance = dr * dr + dg * dg + db * db;
+            if (bestDistance < 0 || distance < bestDistance) {
+                bestDistance = distance;
+                best = static_cast<int>(i);
+                if (distance == 0) break;
+            }
+        }
+        return best;
+    }
+}
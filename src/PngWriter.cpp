@@ -0,0 +1,195 @@
+#include "PngWriter.hpp"
+#include <cstdlib>
+#include <algorithm>
+#include "Palette.hpp"
+
+namespace {
+    // Compressed data is written out in IDAT chunks of roughly this size
+    const size_t IDAT_CHUNK_SIZE = 64 * 1024;
+
+    void appendBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+        out.push_back(static_cast<uint8_t>(value >> 24));
+        out.push_back(static_cast<uint8_t>(value >> 16));
+        out.push_back(static_cast<uint8_t>(value >> 8));
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    uint8_t paeth(int a, int b, int c) {
+        int p = a + b - c;
+        int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc) return static_cast<uint8_t>(a);
+        if (pb <= pc) return static_cast<uint8_t>(b);
+        return static_cast<uint8_t>(c);
+    }
+}
+
+PngWriter::PngWriter(int compressionLevel, unsigned int threads)
+    : deflate(compressionLevel, threads), width(0), height(0), rowsWritten(0) {
+}
+
+void PngWriter::setPalette(const std::vector<RGB>& palette) {
+    this->palette.assign(palette.begin(), palette.begin() + std::min<size_t>(palette.size(), 256));
+    paletteIndex.clear();
+    for (size_t i = 0; i < this->palette.size(); ++i) {
+        paletteIndex.insert(std::make_pair(Palette::packColor(this->palette[i]), static_cast<uint8_t>(i)));
+    }
+}
+
+bool PngWriter::begin(const std::string& filename, int width, int height) {
+    if (width <= 0 || height <= 0) return false;
+
+    if (!openOutput(filename)) return false;
+
+    this->width = width;
+    this->height = height;
+    rowsWritten = 0;
+
+    bool indexed = !palette.empty();
+    size_t rowBytes = static_cast<size_t>(width) * (indexed ? 1 : 3);
+    previousRow.assign(rowBytes, 0);
+    currentRow.assign(rowBytes, 0);
+    candidateRow.assign(rowBytes + 1, 0);
+    bestRow.assign(rowBytes + 1, 0);
+
+    static const uint8_t signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    file->write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    std::vector<uint8_t> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    header.push_back(8);  // bit depth
+    header.push_back(indexed ? 3 : 2);  // color type: indexed or truecolor
+    header.push_back(0);  // compression
+    header.push_back(0);  // filter
+    header.push_back(0);  // interlace
+    writeChunk("IHDR", header.data(), header.size());
+
+    if (indexed) {
+        std::vector<uint8_t> entries;
+        for (const RGB& color : palette) {
+            entries.push_back(color.r);
+            entries.push_back(color.g);
+            entries.push_back(color.b);
+        }
+        writeChunk("PLTE", entries.data(), entries.size());
+    }
+
+    return file->good();
+}
+
+bool PngWriter::writeRow(const RGB* row) {
+    if (!file || rowsWritten >= height) return false;
+
+    if (!palette.empty()) {
+        // Indexed rows use filter type 0, as the PNG spec recommends for palette images
+        RGB lastColor = row[0];
+        uint8_t lastIndex = lookupIndex(lastColor);
+        bestRow[0] = 0;
+        for (int x = 0; x < width; ++x) {
+            if (row[x].r != lastColor.r || row[x].g != lastColor.g || row[x].b != lastColor.b) {
+                lastColor = row[x];
+                lastIndex = lookupIndex(lastColor);
+            }
+            bestRow[x + 1] = lastIndex;
+        }
+    } else {
+        for (int x = 0; x < width; ++x) {
+            currentRow[x * 3] = row[x].r;
+            currentRow[x * 3 + 1] = row[x].g;
+            currentRow[x * 3 + 2] = row[x].b;
+        }
+
+        // Pick the filter with the smallest sum of absolute residuals, as stb does
+        long bestScore = -1;
+        for (int filterType = 0; filterType < 5; ++filterType) {
+            filterRow(filterType, candidateRow);
+            long score = 0;
+            for (size_t i = 1; i < candidateRow.size(); ++i) {
+                score += std::abs(static_cast<int8_t>(candidateRow[i]));
+            }
+            if (bestScore < 0 || score < bestScore) {
+                bestScore = score;
+                bestRow.swap(candidateRow);
+            }
+        }
+    }
+
+    deflate.write(bestRow.data(), bestRow.size(), compressed);
+    previousRow.swap(currentRow);
+    ++rowsWritten;
+
+    flushImageData(false);
+    return file->good();
+}
+
+bool PngWriter::finish() {
+    if (!file) return false;
+
+    bool complete = rowsWritten == height;
+    deflate.finish(compressed);
+    flushImageData(true);
+    writeChunk("IEND", nullptr, 0);
+
+    return closeOutput() && complete;
+}
+
+uint8_t PngWriter::lookupIndex(const RGB& color) {
+    uint32_t key = Palette::packColor(color);
+    auto found = paletteIndex.find(key);
+    if (found != paletteIndex.end()) {
+        return found->second;
+    }
+    uint8_t index = static_cast<uint8_t>(Palette::nearestIndex(palette, color));
+    paletteIndex.insert(std::make_pair(key, index));
+    return index;
+}
+
+void PngWriter::filterRow(int filterType, std::vector<uint8_t>& filtered) const {
+    const size_t bpp = 3;
+    const uint8_t* cur = currentRow.data();
+    const uint8_t* up = previousRow.data();
+    size_t rowBytes = currentRow.size();
+
+    filtered[0] = static_cast<uint8_t>(filterType);
+    uint8_t* out = filtered.data() + 1;
+
+    for (size_t i = 0; i < rowBytes; ++i) {
+        int left = i >= bpp ? cur[i - bpp] : 0;
+        int upLeft = i >= bpp ? up[i - bpp] : 0;
+        switch (filterType) {
+            case 0: out[i] = cur[i]; break;
+            case 1: out[i] = static_cast<uint8_t>(cur[i] - left); break;
+            case 2: out[i] = static_cast<uint8_t>(cur[i] - up[i]); break;
+            case 3: out[i] = static_cast<uint8_t>(cur[i] - ((left + up[i]) >> 1)); break;
+            default: out[i] = static_cast<uint8_t>(cur[i] - paeth(left, up[i], upLeft)); break;
+        }
+    }
+}
+
+void PngWriter::writeChunk(const char* type, const uint8_t* data, size_t size) {
+    std::vector<uint8_t> header;
+    appendBigEndian(header, static_cast<uint32_t>(size));
+    header.insert(header.end(), type, type + 4);
+
+    uint32_t crc = DeflateStream::crc32(0, header.data() + 4, 4);
+    if (size > 0) {
+        crc = DeflateStream::crc32(crc, data, size);
+    }
+
+    std::vector<uint8_t> trailer;
+    appendBigEndian(trailer, crc);
+
+    file->write(reinterpret_cast<const char*>(header.data()), header.size());
+    if (size > 0) {
+        file->write(reinterpret_cast<const char*>(data), size);
+    }
+    file->write(reinterpret_cast<const char*>(trailer.data()), trailer.size());
+}
+
+void PngWriter::flushImageData(bool force) {
+    if (compressed.empty()) return;
+    if (!force && compressed.size() < IDAT_CHUNK_SIZE) return;
+
+    writeChunk("IDAT", compressed.data(), compressed.size());
+    compressed.clear();
+}
@@ -1,6 +1,27 @@
 #include "QuadTree.hpp"
 #include "Utils.hpp"
 #include "ErrorMeasurement.hpp"
+#include "Trace.hpp"
+#include "Stats.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+namespace {
+    // Rendering below this many pixels is not worth the thread startup cost
+    const long long PARALLEL_RENDER_MIN_PIXELS = 512 * 512;
+    // Depth at which the tree is cut into independent render jobs (up to 4^depth subtrees)
+    const int RENDER_SPLIT_DEPTH = 3;
+    // Upper bounds of all but the last error histogram bin, in multiples of the threshold
+    const double ERROR_BIN_BOUNDS[QuadTree::ERROR_BINS - 1] = {0.125, 0.25, 0.5, 1, 2, 4, 8};
+    // Serialized node: leaf flag, RGB and the error as a native double
+    const size_t SERIALIZED_NODE_BYTES = 1 + 3 + sizeof(double);
+}
+
+static_assert(sizeof(RGB) == 3, "renderInto writes leaves into rows of packed RGB triples");
 // ----------------------------------------------------------------------------------------------------
 // ----------------------------------------------------------------------------------------------------
 // QuadTreeNode Class
@@ -73,12 +94,10 @@ void QuadTreeNode::setAverageColor(const RGB& color) {
 }
 
 void QuadTreeNode::setError(double errorValue) {
+    // Kept in the error method's own units so it can be compared with the threshold
     if (errorValue < 0) {
         errorValue = 0;
     }
-    if (errorValue > 1) {
-        errorValue = 1;
-    }
     this->error = errorValue;
 }
 
@@ -106,6 +125,8 @@ void QuadTreeNode::subdivide() {
     int remHeight = height - halfHeight;
 
     // Create four child nodes with adjusted dimensions
+    static Stats::AllocationSite site("quadtree_nodes");
+    Stats::AllocationScope allocations(site);
     children[0] = new QuadTreeNode(x, y, halfWidth, halfHeight);
     children[1] = new QuadTreeNode(x + halfWidth, y, remWidth, halfHeight);
     children[2] = new QuadTreeNode(x, y + halfHeight, halfWidth, remHeight);
@@ -130,7 +151,8 @@ void QuadTreeNode::normalize() {
 // ----------------------------------------------------------------------------------------------------
 // ----------------------------------------------------------------------------------------------------
 // QuadTree Class
-QuadTree::QuadTree(int width, int height) {
+QuadTree::QuadTree(int width, int height)
+    : imageWidth(width), imageHeight(height), totalError(0), nodesEvaluated(0), pixelsScanned(0) {
     root = new QuadTreeNode(0, 0, width, height);
 }
 
@@ -139,14 +161,44 @@ QuadTree::~QuadTree() {
     delete root;
 }
 
+QuadTree::QuadTree(QuadTree&& other) noexcept
+    : root(other.root), imageWidth(other.imageWidth), imageHeight(other.imageHeight),
+      totalError(other.totalError), nodesEvaluated(other.nodesEvaluated), pixelsScanned(other.pixelsScanned),
+      depthStats(std::move(other.depthStats)) {
+    other.root = nullptr;
+}
+
+QuadTree& QuadTree::operator=(QuadTree&& other) noexcept {
+    if (this != &other) {
+        clear();
+        delete root;
+        root = other.root;
+        other.root = nullptr;
+        imageWidth = other.imageWidth;
+        imageHeight = other.imageHeight;
+        totalError = other.totalError;
+        nodesEvaluated = other.nodesEvaluated;
+        pixelsScanned = other.pixelsScanned;
+        depthStats = std::move(other.depthStats);
+    }
+    return *this;
+}
+
 void QuadTree::buildFromImage(const std::vector<std::vector<RGB>>& image, double threshold) {
     clear();
-    buildNodeRecursive(root, image, threshold);
+    resetBuildStats();
+    buildNodeRecursive(root, image, threshold, 0);
+}
+
+void QuadTree::buildFromImage(const std::vector<std::vector<RGB>>& image, const LevelCallback& onLevelComplete) {
+    clear();
+    resetBuildStats();
+    buildLevels(image, onLevelComplete);
 }
 
 void QuadTree::compress(double threshold) {
     if (root) {
-        buildNodeRecursive(root, {}, threshold);
+        buildNodeRecursive(root, {}, threshold, 0);
     }
 }
 
@@ -166,35 +218,271 @@ int QuadTree::countLeafNodes() const {
     return countLeafNodesRecursive(root);
 }
 
+long long QuadTree::getNodesEvaluated() const {
+    return nodesEvaluated;
+}
+
+long long QuadTree::getPixelsScanned() const {
+    return pixelsScanned;
+}
+
+const std::vector<QuadTree::DepthStats>& QuadTree::getDepthStats() const {
+    return depthStats;
+}
+
+int QuadTree::getDepth() const {
+    return static_cast<int>(depthStats.size()) - 1;
+}
+
+long long QuadTree::getNodeCount() const {
+    return nodesEvaluated;
+}
+
+long long QuadTree::getLeafCount() const {
+    long long leaves = 0;
+    for (const DepthStats& depth : depthStats) {
+        leaves += depth.leaves;
+    }
+    return leaves;
+}
+
+double QuadTree::errorBinUpperBound(int bin) {
+    return bin >= 0 && bin < ERROR_BINS - 1 ? ERROR_BIN_BOUNDS[bin] : HUGE_VAL;
+}
+
 void QuadTree::saveToImage(std::vector<std::vector<RGB>>& outputImage) const {
+    renderLeaves(outputImage, nullptr);
+}
+
+void QuadTree::saveToImage(std::vector<std::vector<RGB>>& outputImage, const LeafColorFunction& leafColor) const {
+    renderLeaves(outputImage, &leafColor);
+}
+
+void QuadTree::renderLeaves(std::vector<std::vector<RGB>>& outputImage, const LeafColorFunction* leafColor) const {
     if (!root) return;
 
     int width = root->getBlockWidth();
     int height = root->getBlockHeight();
 
-    outputImage.resize(height, std::vector<RGB>(width));
+    // Reuse existing rows when possible instead of copy-constructing each one
+    {
+        static Stats::AllocationSite site("image_buffers");
+        Stats::AllocationScope allocations(site);
+        outputImage.resize(height);
+        for (auto& row : outputImage) {
+            row.resize(width);
+        }
+    }
 
-    saveNodeToImage(root, outputImage);
+    std::vector<RGB*> rows(height);
+    for (int y = 0; y < height; ++y) {
+        rows[y] = outputImage[y].data();
+    }
+    renderLeaves(rows, leafColor);
 }
 
-void QuadTree::clear() {
+void QuadTree::renderInto(uint8_t* pixels, size_t stride) const {
+    if (!root) return;
+
+    std::vector<RGB*> rows(root->getBlockHeight());
+    for (size_t y = 0; y < rows.size(); ++y) {
+        rows[y] = reinterpret_cast<RGB*>(pixels + y * stride);
+    }
+    renderLeaves(rows, nullptr);
+}
+
+void QuadTree::renderLeaves(const std::vector<RGB*>& rows, const LeafColorFunction* leafColor) const {
+    int width = root->getBlockWidth();
+    int height = root->getBlockHeight();
+
+    // Leaves never overlap, so disjoint subtrees can be rendered concurrently
+    std::vector<std::pair<const QuadTreeNode*, int>> subtrees;
+    collectRenderSubtrees(root, 0, RENDER_SPLIT_DEPTH, subtrees);
+
+    unsigned int threadCount = Utils::ProgramOptions::threads > 0
+        ? static_cast<unsigned int>(Utils::ProgramOptions::threads)
+        : std::max(1u, std::thread::hardware_concurrency());
+    threadCount = std::min(threadCount, static_cast<unsigned int>(subtrees.size()));
+
+    if (threadCount <= 1 || static_cast<long long>(width) * height < PARALLEL_RENDER_MIN_PIXELS) {
+        saveNodeToImage(root, 0, rows, leafColor);
+        return;
+    }
+
+    std::atomic<size_t> nextSubtree(0);
+    auto worker = [&]() {
+        for (size_t i = nextSubtree++; i < subtrees.size(); i = nextSubtree++) {
+            const QuadTreeNode* subtree = subtrees[i].first;
+            Trace::Scope trace("render subtree", "render");
+            trace.arg("x", subtree->getPosX()).arg("y", subtree->getPosY())
+                 .arg("width", subtree->getBlockWidth()).arg("height", subtree->getBlockHeight());
+            saveNodeToImage(subtree, subtrees[i].second, rows, leafColor);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < threadCount; ++t) {
+        workers.emplace_back([&worker]() {
+            Trace::setThreadName("render worker");
+            worker();
+        });
+    }
+    worker();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+}
+
+void QuadTree::renderRow(int y, std::vector<RGB>& row) const {
+    if (!root) return;
+
+    row.resize(root->getBlockWidth());
+    renderNodeRow(root, y, row);
+}
+
+void QuadTree::write(std::ostream& out) const {
+    std::string data;
     if (root) {
+        data.reserve(static_cast<size_t>(nodesEvaluated) * SERIALIZED_NODE_BYTES);
+        writeNode(root, data);
+    }
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+bool QuadTree::read(std::istream& in, double threshold) {
+    // Read in one piece; cache entries run to tens of megabytes
+    std::string data;
+    std::streampos start = in.tellg();
+    if (in.seekg(0, std::ios::end)) {
+        data.resize(static_cast<size_t>(in.tellg() - start));
+        in.seekg(start);
+        if (!in.read(&data[0], static_cast<std::streamsize>(data.size()))) data.clear();
+    }
+    clear();
+    resetBuildStats();
+    if (!root) return false;
+
+    size_t pos = 0;
+    if (!readNode(root, data, pos, 0, threshold) || pos != data.size()) {
+        clear();
+        resetBuildStats();
+        return false;
+    }
+    return true;
+}
+
+void QuadTree::writeNode(const QuadTreeNode* node, std::string& data) const {
+    char bytes[SERIALIZED_NODE_BYTES];
+    bytes[0] = node->isNodeLeaf() ? 1 : 0;
+    bytes[1] = static_cast<char>(node->avgColor.r);
+    bytes[2] = static_cast<char>(node->avgColor.g);
+    bytes[3] = static_cast<char>(node->avgColor.b);
+    std::memcpy(bytes + 4, &node->error, sizeof(double));
+    data.append(bytes, sizeof(bytes));
+
+    if (!node->isNodeLeaf()) {
         for (int i = 0; i < 4; ++i) {
-            delete root->getChildAt(i);
-            root->setChildNode(i, nullptr);
+            writeNode(node->getChildAt(i), data);
         }
     }
+}
+
+bool QuadTree::readNode(QuadTreeNode* node, const std::string& data, size_t& pos, int depth, double threshold) {
+    if (data.size() - pos < SERIALIZED_NODE_BYTES) return false;
+    const char* bytes = data.data() + pos;
+    pos += SERIALIZED_NODE_BYTES;
 
+    bool leaf = bytes[0] == 1;
+    if (!leaf && (bytes[0] != 0 || node->getBlockWidth() < 2 || node->getBlockHeight() < 2)) return false;
+    node->setAverageColor({static_cast<uint8_t>(bytes[1]), static_cast<uint8_t>(bytes[2]),
+                           static_cast<uint8_t>(bytes[3])});
+    double error;
+    std::memcpy(&error, bytes + 4, sizeof(double));
+    node->setError(error);
+
+    ++nodesEvaluated;
+    recordNode(depth, node->getError(), !leaf, threshold);
+
+    if (leaf) {
+        node->markAsLeaf(true);
+        return true;
+    }
+    node->subdivide();
+    for (int i = 0; i < 4; ++i) {
+        if (!readNode(node->getChildAt(i), data, pos, depth + 1, threshold)) return false;
+    }
+    return true;
+}
+
+void QuadTree::clear() {
+    // Back to a single leaf block, so a root that is never split still renders
+    if (root) {
+        root->markAsLeaf(true);
+    }
 }
 
-void QuadTree::buildNodeRecursive(QuadTreeNode* node, const std::vector<std::vector<RGB>>& image, double threshold) {
+void QuadTree::buildNodeRecursive(QuadTreeNode* node, const std::vector<std::vector<RGB>>& image, double threshold, int depth) {
     if (!node) return;
 
+    // Only subtrees above the cutoff are traced, so the trace stays small on large images
+    Trace::Scope trace("subtree", "build", node->getBlockWidth() >= Utils::ProgramOptions::traceMinBlock &&
+                                           node->getBlockHeight() >= Utils::ProgramOptions::traceMinBlock);
+    trace.arg("x", node->getPosX()).arg("y", node->getPosY())
+         .arg("width", node->getBlockWidth()).arg("height", node->getBlockHeight());
+
+    if (evaluateNode(node, image, depth)) {
+        node->subdivide();
+        for (int i = 0; i < 4; ++i) {
+            buildNodeRecursive(node->getChildAt(i), image, Utils::ProgramOptions::threshold, depth + 1);
+        }
+    }
+}
+
+void QuadTree::buildLevels(const std::vector<std::vector<RGB>>& image, const LevelCallback& onLevelComplete) {
+    // Only the current level and the one below it are kept
+    std::vector<QuadTreeNode*> level(1, root), next;
+    for (int depth = 0; !level.empty(); ++depth) {
+        next.clear();
+        Trace::Scope trace("level", "build");
+        trace.arg("depth", depth).arg("nodes", static_cast<long long>(level.size()));
+        for (QuadTreeNode* node : level) {
+            if (evaluateNode(node, image, depth)) {
+                node->subdivide();
+                for (int i = 0; i < 4; ++i) {
+                    next.push_back(node->getChildAt(i));
+                }
+            }
+        }
+        trace.end();
+
+        if (onLevelComplete) {
+            onLevelComplete(depth, level);
+        }
+        level.swap(next);
+    }
+}
+
+void QuadTree::resetBuildStats() {
+    nodesEvaluated = pixelsScanned = 0;
+    depthStats.clear();
+}
+
+bool QuadTree::evaluateNode(QuadTreeNode* node, const std::vector<std::vector<RGB>>& image, int depth) {
     int x = node->getPosX();
     int y = node->getPosY();
     int width = node->getBlockWidth();
     int height = node->getBlockHeight();
 
+    ++nodesEvaluated;
+    pixelsScanned += 2LL * width * height;
+
+    // Two clock reads per node are noticeable on small blocks, so timing is opt-in
+    bool timed = Utils::ProgramOptions::verbose;
+    std::chrono::steady_clock::time_point start;
+    if (timed) {
+        start = std::chrono::steady_clock::now();
+    }
+
     // Calculate average color for the node
     RGB avgColor = ErrorMeasurement::calculateAverageColor(image, x, y, width, height);
     node->setAverageColor(avgColor);
@@ -206,16 +494,40 @@ void QuadTree::buildNodeRecursive(QuadTreeNode* node, const std::vector<std::vec
     node->setError(error);
 
     // Check if we should subdivide based on threshold
-    if (error > Utils::ProgramOptions::threshold &&
+    double threshold = Utils::ProgramOptions::threshold;
+    bool split = error > threshold &&
         width >= Utils::ProgramOptions::minBlockSize &&
         height >= Utils::ProgramOptions::minBlockSize &&
         width / 2 >= Utils::ProgramOptions::minBlockSize &&
-        height / 2 >= Utils::ProgramOptions::minBlockSize) {
-        node->subdivide();
-        for (int i = 0; i < 4; ++i) {
-            buildNodeRecursive(node->getChildAt(i), image, Utils::ProgramOptions::threshold);
-        }
-        }
+        height / 2 >= Utils::ProgramOptions::minBlockSize;
+
+    DepthStats& stats = recordNode(depth, error, split, threshold);
+    if (timed) {
+        stats.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    stats.pixelsScanned += 2LL * width * height;
+
+    return split;
+}
+
+QuadTree::DepthStats& QuadTree::recordNode(int depth, double error, bool split, double threshold) {
+    if (depth >= static_cast<int>(depthStats.size())) {
+        depthStats.resize(depth + 1);
+    }
+    DepthStats& stats = depthStats[depth];
+    ++stats.nodes;
+    stats.leaves += split ? 0 : 1;
+    stats.errorSum += error;
+    stats.errorMax = std::max(stats.errorMax, error);
+
+    // Counting the bounds below the error avoids a hard-to-predict branch per bin
+    int bin = 0;
+    for (double bound : ERROR_BIN_BOUNDS) {
+        bin += error > threshold * bound;
+    }
+    ++stats.errorHistogram[bin];
+
+    return stats;
 }
 
 int QuadTree::countNodesRecursive(const QuadTreeNode* node) const {
@@ -242,23 +554,61 @@ int QuadTree::countLeafNodesRecursive(const QuadTreeNode* node) const {
     return count;
 }
 
-void QuadTree::saveNodeToImage(const QuadTreeNode* node, std::vector<std::vector<RGB>>& outputImage) const {
+void QuadTree::saveNodeToImage(const QuadTreeNode* node, int depth, const std::vector<RGB*>& rows,
+                               const LeafColorFunction* leafColor) const {
     if (!node) return;
 
     if (node->isNodeLeaf()) {
-        for (int y = node->getPosY(); y < node->getPosY() + node->getBlockHeight(); ++y) {
-            for (int x = node->getPosX(); x < node->getPosX() + node->getBlockWidth(); ++x) {
-                // Add bounds checking to avoid segmentation faults
-                if (y < outputImage.size() && x < outputImage[0].size()) {
-                    outputImage[y][x] = node->getAverageColor();
-                }
-            }
+        if (rows.empty()) return;
+
+        // Clip the block once, then fill each row as a single span
+        int x0 = std::max(0, node->getPosX());
+        int y0 = std::max(0, node->getPosY());
+        int x1 = std::min(node->getPosX() + node->getBlockWidth(), root->getBlockWidth());
+        int y1 = std::min(node->getPosY() + node->getBlockHeight(), static_cast<int>(rows.size()));
+        if (x1 <= x0) return;
+
+        RGB color = leafColor ? (*leafColor)(*node, depth) : node->getAverageColor();
+        for (int y = y0; y < y1; ++y) {
+            std::fill_n(rows[y] + x0, x1 - x0, color);
         }
     } else {
         for (int i = 0; i < 4; ++i) {
-            saveNodeToImage(node->getChildAt(i), outputImage);
+            saveNodeToImage(node->getChildAt(i), depth + 1, rows, leafColor);
         }
     }
 }
+
+void QuadTree::renderNodeRow(const QuadTreeNode* node, int y, std::vector<RGB>& row) const {
+    if (!node) return;
+
+    // Only descend into blocks that intersect this scanline
+    if (y < node->getPosY() || y >= node->getPosY() + node->getBlockHeight()) return;
+
+    if (node->isNodeLeaf()) {
+        int x0 = std::max(0, node->getPosX());
+        int x1 = std::min(node->getPosX() + node->getBlockWidth(), static_cast<int>(row.size()));
+        if (x1 > x0) {
+            std::fill_n(row.begin() + x0, x1 - x0, node->getAverageColor());
+        }
+    } else {
+        for (int i = 0; i < 4; ++i) {
+            renderNodeRow(node->getChildAt(i), y, row);
+        }
+    }
+}
+
+void QuadTree::collectRenderSubtrees(const QuadTreeNode* node, int depth, int splitDepth,
+                                     std::vector<std::pair<const QuadTreeNode*, int>>& subtrees) const {
+    if (!node) return;
+
+    if (depth == splitDepth || node->isNodeLeaf()) {
+        subtrees.push_back(std::make_pair(node, depth));
+        return;
+    }
+    for (int i = 0; i < 4; ++i) {
+        collectRenderSubtrees(node->getChildAt(i), depth + 1, splitDepth, subtrees);
+    }
+}
 // ----------------------------------------------------------------------------------------------------
 // ----------------------------------------------------------------------------------------------------
\ No newline at end of file
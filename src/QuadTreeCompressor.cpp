@@ -1,40 +1,171 @@
 #include "QuadTreeCompressor.hpp"
 #include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cmath>
 
 #include "Utils.hpp"
+#include "Stats.hpp"
+#include "ResultCache.hpp"
 
 // Constructor
 QuadTreeCompressor::QuadTreeCompressor()
-    : originalSize(0), compressedSize(0) {
+    : originalSize(0), compressedSize(0), annotate(false), annotateNextBuild(false) {
+}
+
+void QuadTreeCompressor::enableAnnotations(const std::string& directory) {
+    annotate = true;
+    annotationDirectory = directory;
+    if (!directory.empty() && !Utils::createDirectory(directory)) {
+        std::cerr << "Error: Failed to create annotation directory: " << directory << std::endl;
+        annotationDirectory.clear();
+    }
+}
+
+std::string QuadTreeCompressor::annotationFile(uint64_t imageHash) const {
+    std::ostringstream name;
+    name << annotationDirectory << "/" << std::hex << std::setw(16) << std::setfill('0') << imageHash << ".qta";
+    return name.str();
+}
+
+AnnotatedTree& QuadTreeCompressor::annotationsFor(const std::vector<std::vector<RGB>>& image) {
+    int width = image[0].size();
+    int height = image.size();
+    uint64_t imageHash = ResultCache::hashPixels(image);
+    if (annotations && annotations->matches(width, height, imageHash)) {
+        return *annotations;
+    }
+
+    annotations.reset();
+    if (!annotationDirectory.empty()) {
+        annotations = AnnotatedTree::load(annotationFile(imageHash), width, height, imageHash);
+    }
+    if (!annotations) {
+        annotations.reset(new AnnotatedTree(width, height, imageHash));
+    }
+    return *annotations;
 }
 
 // Main compression function
 QuadTree QuadTreeCompressor::compressImage(
     const std::vector<std::vector<RGB>>& image,
     double threshold,
-    const std::string& errorMethod) {
+    const std::string& errorMethod,
+    const QuadTree::LevelCallback& onLevelComplete) {
 
     if (image.empty() || image[0].empty()) {
         throw std::invalid_argument("Empty image provided for compression");
     }
 
-    // Calculate the original size (3 bytes per pixel for RGB)
     int width = image[0].size();
     int height = image.size();
-    originalSize = width * height * 3;
+    QuadTree tree(width, height);
+
+    // A target-ratio search lends its annotated tree to the build that follows it
+    bool useAnnotations = annotate || annotateNextBuild;
+    annotateNextBuild = false;
+    if (useAnnotations) {
+        AnnotatedTree& annotated = annotationsFor(image);
+        annotated.build(tree, image, errorMethod, threshold, Utils::ProgramOptions::minBlockSize, onLevelComplete);
+        Stats::addCounter("annotated_blocks_reused", annotated.getReusedCount());
+        Stats::addCounter("annotated_blocks_computed", annotated.getComputedCount());
+        if (!annotationDirectory.empty() && annotated.isModified() &&
+            !annotated.save(annotationFile(annotated.getImageHash()))) {
+            std::cerr << "Error: Failed to save annotated tree to: " << annotationDirectory << std::endl;
+        }
+    } else if (onLevelComplete) {
+        tree.buildFromImage(image, onLevelComplete);
+    } else {
+        tree.buildFromImage(image, threshold);
+    }
+    if (!annotate) {
+        annotations.reset();
+    }
+
+    measure(tree);
+    return tree;
+}
+
+void QuadTreeCompressor::measure(const QuadTree& tree) {
+    // Calculate the original size (3 bytes per pixel for RGB)
+    const QuadTreeNode* root = tree.getRoot();
+    originalSize = root ? root->getBlockWidth() * root->getBlockHeight() * 3 : 0;
 
     // Note: This is the theoretical memory size, not the file size
     // Actual file size depends on the image format (JPEG, PNG, etc.)
     // which already includes compression
 
-    QuadTree tree(width, height);
+    long long leafNodes = tree.getLeafCount();
+    compressedSize = leafNodes * (4*sizeof(int) + 3);
+}
 
-    tree.buildFromImage(image, threshold);
+// Binary search for the threshold whose compression ratio is closest to the target
+double QuadTreeCompressor::adjustThresholdForTargetRatio(
+    const std::vector<std::vector<RGB>>& image,
+    double targetRatio,
+    double initialThreshold,
+    const std::string& errorMethod,
+    int minBlockSize) {
 
-    int leafNodes = tree.countLeafNodes();
-    compressedSize = leafNodes * (4*sizeof(int) + 3);
+    // Initial threshold guesses
+    double lowThreshold = 0.1;
+    double highThreshold = 1000.0;
+    double currentThreshold = initialThreshold;
+    double bestThreshold = currentThreshold;
+    double bestRatioDifference = 1.0; // Start with a large difference
 
-    return tree;
+    // Binary search for the threshold that gives closest to the target ratio
+    const int MAX_ITERATIONS = 15; // Usually converges in <15 iterations
+
+    if (image.empty() || image[0].empty()) {
+        throw std::invalid_argument("Empty image provided for compression");
+    }
+
+    // Each step only needs the leaf count, which the annotated tree gives without creating nodes,
+    // and only reads the pixels of blocks the earlier steps did not reach. The caller's final build
+    // reuses the annotated tree and, with annotations enabled, saves it.
+    annotateNextBuild = true;
+    AnnotatedTree& annotated = annotationsFor(image);
+    originalSize = image[0].size() * image.size() * 3;
+
+    for (int i = 0; i < MAX_ITERATIONS; i++) {
+        // Set the current threshold for compression
+        Utils::ProgramOptions::threshold = currentThreshold;
+        Utils::ProgramOptions::minBlockSize = minBlockSize;
+        Utils::ProgramOptions::errorMethod = errorMethod;
+
+        // Test compression with current threshold
+        long long leafNodes = annotated.countLeaves(image, errorMethod, currentThreshold, minBlockSize);
+        compressedSize = leafNodes * (4*sizeof(int) + 3);
+        Stats::addCounter("annotated_blocks_reused", annotated.getReusedCount());
+        Stats::addCounter("annotated_blocks_computed", annotated.getComputedCount());
+
+        // Calculate actual compression ratio
+        double actualRatio = getCompressionRatio();
+        double ratioDifference = std::fabs(actualRatio - targetRatio);
+
+        // Store the best threshold found so far
+        if (ratioDifference < bestRatioDifference) {
+            bestRatioDifference = ratioDifference;
+            bestThreshold = currentThreshold;
+
+            // If we're very close to the target, we can stop
+            if (ratioDifference < 0.005) { // Within 0.5%
+                break;
+            }
+        }
+
+        // Binary search adjustment
+        if (actualRatio < targetRatio) {
+            highThreshold = currentThreshold;
+            currentThreshold = (lowThreshold + currentThreshold) / 2;
+        } else {
+            lowThreshold = currentThreshold;
+            currentThreshold = (highThreshold + currentThreshold) / 2;
+        }
+    }
+
+    return bestThreshold;
 }
 
 double QuadTreeCompressor::getCompressionRatio() const {
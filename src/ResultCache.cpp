@@ -0,0 +1,309 @@
+#include "ResultCache.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include "ImageProcessor.hpp"
+#include "Utils.hpp"
+#include "Stats.hpp"
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#include <utime.h>
+#endif
+
+static_assert(sizeof(RGB) == 3, "rows are hashed as packed RGB triples");
+
+namespace {
+    const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+    const uint64_t FNV_OFFSET = 0xCBF29CE484222325ULL;
+    const uint64_t FNV_PRIME = 0x100000001B3ULL;
+
+    // Two 64-bit hashes in hex
+    const size_t KEY_LENGTH = 32;
+
+    const uint32_t TREE_MAGIC = 0x43525451;  // "QTRC" in little-endian byte order
+    const uint32_t TREE_VERSION = 1;
+
+    // Start of a .tree file, in native byte order; the serialized nodes follow
+    struct TreeHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        double threshold;  // After the target-ratio search, if there was one
+    };
+
+    const size_t COPY_CHUNK_BYTES = 64 * 1024;
+
+    uint64_t rotateLeft(uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    // xxHash64's lane round and final avalanche
+    uint64_t hashRound(uint64_t lane, uint64_t word) {
+        return rotateLeft(lane + word * PRIME2, 31) * PRIME1;
+    }
+
+    uint64_t avalanche(uint64_t hash) {
+        hash ^= hash >> 33;
+        hash *= PRIME2;
+        hash ^= hash >> 29;
+        hash *= PRIME3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    std::string toHex(uint64_t value) {
+        std::ostringstream text;
+        text << std::hex << std::setw(16) << std::setfill('0') << value;
+        return text.str();
+    }
+
+    bool copyToOutput(std::istream& in, const std::string& outputFile) {
+        FILE* out = outputFile == "-" ? stdout : std::fopen(outputFile.c_str(), "wb");
+        if (!out) return false;
+
+        std::vector<char> buffer(COPY_CHUNK_BYTES);
+        bool ok = true;
+        while (ok && in) {
+            in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            size_t count = static_cast<size_t>(in.gcount());
+            ok = std::fwrite(buffer.data(), 1, count, out) == count;
+        }
+        ok = ok && in.eof();
+        return (out == stdout ? std::fflush(out) == 0 : std::fclose(out) == 0) && ok;
+    }
+
+    // Marks a file as just used for the LRU order
+    void touch(const std::string& file) {
+#ifndef _WIN32
+        utime(file.c_str(), nullptr);
+#else
+        (void)file;
+#endif
+    }
+}
+
+ResultCache::ResultCache(const std::string& directory, long long maxBytes)
+    : directory(directory), maxBytes(maxBytes) {
+    if (this->directory.empty()) return;
+#ifdef _WIN32
+    std::cerr << "Error: The result cache needs POSIX file times and is not available on Windows" << std::endl;
+    this->directory.clear();
+#else
+    if (!Utils::createDirectory(this->directory)) {
+        std::cerr << "Error: Failed to create cache directory: " << this->directory << std::endl;
+        this->directory.clear();
+    }
+#endif
+}
+
+bool ResultCache::enabled() const {
+    return !directory.empty();
+}
+
+uint64_t ResultCache::hashPixels(const std::vector<std::vector<RGB>>& image) {
+    uint64_t width = image.empty() ? 0 : image[0].size();
+    uint64_t height = image.size();
+    uint64_t seed = width * PRIME3 ^ height;
+    uint64_t lanes[4] = {seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1};
+
+    // Each row is read as 32-byte stripes over four independent lanes, then its zero-padded tail
+    for (const std::vector<RGB>& row : image) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(row.data());
+        size_t size = row.size() * sizeof(RGB);
+        size_t pos = 0;
+        for (; pos + 32 <= size; pos += 32) {
+            uint64_t words[4];
+            std::memcpy(words, bytes + pos, sizeof(words));
+            for (int lane = 0; lane < 4; ++lane) {
+                lanes[lane] = hashRound(lanes[lane], words[lane]);
+            }
+        }
+        for (int lane = 0; pos < size; ++lane, pos += 8) {
+            uint64_t word = 0;
+            std::memcpy(&word, bytes + pos, std::min<size_t>(8, size - pos));
+            lanes[lane] = hashRound(lanes[lane], word);
+        }
+    }
+
+    uint64_t hash = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) + rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+    return avalanche(hash ^ width * height * sizeof(RGB));
+}
+
+std::string ResultCache::makeKey(const std::vector<std::vector<RGB>>& image, const std::string& errorMethod,
+                                 double threshold, int minBlockSize, double targetRatio) {
+    // Doubles are printed exactly, so only identical options share an entry
+    std::ostringstream options;
+    options << std::setprecision(17) << errorMethod << " " << threshold << " " << minBlockSize << " " << targetRatio;
+
+    uint64_t optionsHash = FNV_OFFSET;
+    for (char c : options.str()) {
+        optionsHash = (optionsHash ^ static_cast<unsigned char>(c)) * FNV_PRIME;
+    }
+    return toHex(hashPixels(image)) + toHex(avalanche(optionsHash));
+}
+
+bool ResultCache::loadTree(const std::string& key, QuadTree& tree, double& threshold) const {
+    if (!enabled()) return false;
+
+    std::string file = directory + "/" + key + ".tree";
+    std::ifstream in(file, std::ios::binary);
+    const QuadTreeNode* root = tree.getRoot();
+    TreeHeader header;
+    bool hit = in.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+               header.magic == TREE_MAGIC && header.version == TREE_VERSION && root &&
+               header.width == static_cast<uint32_t>(root->getBlockWidth()) &&
+               header.height == static_cast<uint32_t>(root->getBlockHeight()) &&
+               tree.read(in, header.threshold);
+
+    Stats::addCounter("cache_hits", hit ? 1 : 0);
+    Stats::addCounter("cache_misses", hit ? 0 : 1);
+    if (hit) {
+        threshold = header.threshold;
+        touch(file);
+    }
+    return hit;
+}
+
+void ResultCache::storeTree(const std::string& key, const QuadTree& tree, double threshold) const {
+    const QuadTreeNode* root = tree.getRoot();
+    if (!enabled() || !root) return;
+
+    std::string file = directory + "/" + key + ".tree";
+    std::string temporaryFile = Utils::temporaryPath(file);
+    {
+        std::ofstream out(temporaryFile, std::ios::binary);
+        TreeHeader header = {TREE_MAGIC, TREE_VERSION, static_cast<uint32_t>(root->getBlockWidth()),
+                             static_cast<uint32_t>(root->getBlockHeight()), threshold};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        tree.write(out);
+        if (!out.good()) {
+            out.close();
+            std::remove(temporaryFile.c_str());
+            std::cerr << "Error: Failed to write cache entry: " << file << std::endl;
+            return;
+        }
+    }
+    commit(temporaryFile, file);
+}
+
+bool ResultCache::loadOutput(const std::string& key, const std::string& outputFile, bool quantizePalette) const {
+    if (!enabled()) return false;
+
+    std::string tag = outputTag(outputFile, quantizePalette);
+    bool hit = false;
+    if (!tag.empty()) {
+        std::string file = directory + "/" + key + "." + tag;
+        std::ifstream in(file, std::ios::binary);
+        if (in.is_open()) {
+            // Same as the encoders, which create the output's directory
+            std::string outputDirectory = Utils::getDirectoryPath(Utils::normalizePath(outputFile));
+            if (outputFile != "-" && !outputDirectory.empty()) Utils::createDirectory(outputDirectory);
+            hit = copyToOutput(in, outputFile);
+            if (hit) touch(file);
+        }
+    }
+
+    Stats::addCounter("cache_output_hits", hit ? 1 : 0);
+    Stats::addCounter("cache_output_misses", hit ? 0 : 1);
+    return hit;
+}
+
+void ResultCache::storeOutput(const std::string& key, const std::string& outputFile, bool quantizePalette) const {
+    std::string tag = outputTag(outputFile, quantizePalette);
+    if (!enabled() || tag.empty() || outputFile == "-") return;
+
+    std::string file = directory + "/" + key + "." + tag;
+    std::string temporaryFile = Utils::temporaryPath(file);
+    std::ifstream in(outputFile, std::ios::binary);
+    if (!in.is_open() || !copyToOutput(in, temporaryFile)) {
+        std::remove(temporaryFile.c_str());
+        std::cerr << "Error: Failed to write cache entry: " << file << std::endl;
+        return;
+    }
+    commit(temporaryFile, file);
+}
+
+std::string ResultCache::outputTag(const std::string& outputFile, bool quantizePalette) {
+    std::string format = ImageProcessor::outputFormat(outputFile);
+    if (format == "png") {
+        return "png" + std::to_string(Utils::ProgramOptions::pngCompressionLevel) + (quantizePalette ? "p" : "");
+    }
+    if (format == "jpg") return "jpg" + std::to_string(Utils::ProgramOptions::jpegQuality);
+    if (format == "ppm" || format == "pam") return format;
+    // Other extensions are saved under a different name
+    return "";
+}
+
+void ResultCache::commit(const std::string& temporaryFile, const std::string& file) const {
+    if (std::rename(temporaryFile.c_str(), file.c_str()) != 0) {
+        std::remove(temporaryFile.c_str());
+        std::cerr << "Error: Failed to write cache entry: " << file << std::endl;
+        return;
+    }
+    evict();
+}
+
+void ResultCache::evict() const {
+#ifndef _WIN32
+    struct Entry {
+        long long bytes = 0;
+        time_t lastUse = 0;
+        std::vector<std::string> files;
+    };
+
+    // Only files named <key>.<suffix> belong to the cache; anything else in the directory is left alone
+    std::map<std::string, Entry> entries;
+    long long totalBytes = 0;
+    DIR* listing = opendir(directory.c_str());
+    if (!listing) return;
+    while (dirent* item = readdir(listing)) {
+        std::string name = item->d_name;
+        if (name.size() <= KEY_LENGTH || name[KEY_LENGTH] != '.' ||
+            name.find_first_not_of("0123456789abcdef") < KEY_LENGTH) {
+            continue;
+        }
+
+        std::string path = directory + "/" + name;
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) continue;
+
+        Entry& entry = entries[name.substr(0, KEY_LENGTH)];
+        entry.bytes += static_cast<long long>(info.st_size);
+        entry.lastUse = std::max(entry.lastUse, info.st_mtime);
+        entry.files.push_back(path);
+        totalBytes += static_cast<long long>(info.st_size);
+    }
+    closedir(listing);
+    if (totalBytes <= maxBytes) return;
+
+    std::vector<const Entry*> oldestFirst;
+    for (const auto& entry : entries) {
+        oldestFirst.push_back(&entry.second);
+    }
+    std::sort(oldestFirst.begin(), oldestFirst.end(),
+              [](const Entry* a, const Entry* b) { return a->lastUse < b->lastUse; });
+
+    long long evicted = 0;
+    for (const Entry* entry : oldestFirst) {
+        if (totalBytes <= maxBytes) break;
+        for (const std::string& file : entry->files) {
+            std::remove(file.c_str());
+        }
+        totalBytes -= entry->bytes;
+        ++evicted;
+    }
+    Stats::addCounter("cache_evictions", evicted);
+#endif
+}
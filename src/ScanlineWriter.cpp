@@ -0,0 +1,58 @@
+#include "ScanlineWriter.hpp"
+#include <cstdio>
+#include <fstream>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace {
+    // Writes through the C stdout stream rather than std::cout, so the image still reaches
+    // standard output when std::cout has been redirected for progress messages
+    class StdoutBuffer : public std::streambuf {
+    protected:
+        std::streamsize xsputn(const char* data, std::streamsize size) override {
+            return static_cast<std::streamsize>(std::fwrite(data, 1, static_cast<size_t>(size), stdout));
+        }
+
+        int_type overflow(int_type c) override {
+            if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+            return std::fputc(c, stdout) == EOF ? traits_type::eof() : c;
+        }
+
+        int sync() override {
+            return std::fflush(stdout) == 0 ? 0 : -1;
+        }
+    };
+}
+
+bool ScanlineWriter::openOutput(const std::string& filename) {
+    if (filename == "-") {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        stdoutBuffer.reset(new StdoutBuffer());
+        file.reset(new std::ostream(stdoutBuffer.get()));
+        return true;
+    }
+
+    std::unique_ptr<std::ofstream> stream(new std::ofstream(filename, std::ios::binary));
+    if (!stream->is_open()) return false;
+    file.reset(stream.release());
+    return true;
+}
+
+bool ScanlineWriter::closeOutput() {
+    if (!file) return false;
+
+    file->flush();
+    bool success = !file->fail();
+    if (std::ofstream* stream = dynamic_cast<std::ofstream*>(file.get())) {
+        stream->close();
+        success = success && !stream->fail();
+    }
+    file.reset();
+    stdoutBuffer.reset();
+    return success;
+}
@@ -0,0 +1,660 @@
+#include "Server.hpp"
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include "ImageProcessor.hpp"
+#include "QuadTreeCompressor.hpp"
+#include "GifGenerator.hpp"
+#include "CostMap.hpp"
+#include "Utils.hpp"
+#include "Stats.hpp"
+#include "Metrics.hpp"
+#include "SharedImage.hpp"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN32
+namespace {
+    // Largest image accepted in a "data" block
+    const size_t MAX_DATA_BYTES = size_t(1) << 30;
+    // Longest request or reply line
+    const size_t MAX_LINE_BYTES = 64 * 1024;
+
+    volatile sig_atomic_t signalled = 0;
+
+    void onSignal(int) {
+        signalled = 1;
+    }
+
+    // Buffered line and block reads on one socket; the descriptor is closed with the object
+    class Connection {
+    public:
+        explicit Connection(int fd) : fd(fd) {}
+        ~Connection() { close(fd); }
+
+        bool readLine(std::string& line) {
+            size_t newline;
+            while ((newline = buffer.find('\n')) == std::string::npos) {
+                if (buffer.size() > MAX_LINE_BYTES || !fill()) return false;
+            }
+            line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            return true;
+        }
+
+        bool readBytes(size_t count, std::string& bytes) {
+            while (buffer.size() < count) {
+                if (!fill()) return false;
+            }
+            bytes = buffer.substr(0, count);
+            buffer.erase(0, count);
+            return true;
+        }
+
+        bool write(const std::string& bytes) {
+            size_t sent = 0;
+            while (sent < bytes.size()) {
+                ssize_t written = ::write(fd, bytes.data() + sent, bytes.size() - sent);
+                if (written < 0 && errno == EINTR) continue;
+                if (written <= 0) return false;
+                sent += static_cast<size_t>(written);
+            }
+            return true;
+        }
+
+    private:
+        int fd;
+        std::string buffer;
+
+        bool fill() {
+            char chunk[64 * 1024];
+            for (;;) {
+                ssize_t received = ::read(fd, chunk, sizeof(chunk));
+                if (received < 0 && errno == EINTR) continue;
+                if (received <= 0) return false;
+                buffer.append(chunk, static_cast<size_t>(received));
+                return true;
+            }
+        }
+    };
+
+    struct Request {
+        std::vector<std::string> args;
+        std::string data;
+        bool hasData = false;
+        bool returnData = false;
+        bool shutdown = false;
+    };
+
+    struct Response {
+        bool ok = false;
+        std::string message;
+        std::vector<std::pair<std::string, std::string>> fields;
+        std::string data;
+        bool hasData = false;
+    };
+
+    // Byte counts are checked by hand so a malformed request is an error reply, not an exception
+    bool parseSize(const std::string& text, size_t& value) {
+        if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos || text.size() > 12) return false;
+        value = static_cast<size_t>(std::stoull(text));
+        return true;
+    }
+
+    bool readRequest(Connection& connection, Request& request, std::string& error) {
+        std::string line;
+        while (connection.readLine(line)) {
+            if (line == "end") return true;
+            if (line.compare(0, 4, "arg ") == 0) {
+                request.args.push_back(line.substr(4));
+            } else if (line.compare(0, 5, "data ") == 0) {
+                size_t size;
+                if (!parseSize(line.substr(5), size) || size > MAX_DATA_BYTES) {
+                    error = "invalid data size";
+                    return false;
+                }
+                if (!connection.readBytes(size, request.data)) break;
+                request.hasData = true;
+            } else if (line == "return-data") {
+                request.returnData = true;
+            } else if (line == "shutdown") {
+                request.shutdown = true;
+            } else {
+                error = "unknown request line: " + line.substr(0, 64);
+                return false;
+            }
+        }
+        error = "connection closed before end of request";
+        return false;
+    }
+
+    bool writeResponse(Connection& connection, const Response& response) {
+        std::ostringstream header;
+        if (response.ok) {
+            header << "ok\n";
+        } else {
+            std::string message = response.message;
+            std::replace(message.begin(), message.end(), '\n', ' ');
+            header << "error " << message << "\n";
+        }
+        for (const auto& field : response.fields) {
+            header << field.first << " " << field.second << "\n";
+        }
+        if (response.hasData) {
+            header << "data " << response.data.size() << "\n";
+        }
+        if (!connection.write(header.str())) return false;
+        if (response.hasData && !connection.write(response.data)) return false;
+        return connection.write("end\n");
+    }
+
+    long long fileSize(const std::string& filename) {
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        return file.is_open() ? static_cast<long long>(file.tellg()) : 0;
+    }
+
+    double phaseWallMs(const std::string& name) {
+        for (const Stats::Phase& phase : Stats::getPhases()) {
+            if (phase.name == name) return phase.wallMs;
+        }
+        return 0;
+    }
+
+    // The compression options are process-wide statics, so every request starts from the
+    // daemon's own settings rather than from whatever the previous request left behind
+    struct SharedOptions {
+        std::string errorMethod = Utils::ProgramOptions::errorMethod;
+        double threshold = Utils::ProgramOptions::threshold;
+        int minBlockSize = Utils::ProgramOptions::minBlockSize;
+        double targetCompressionRatio = Utils::ProgramOptions::targetCompressionRatio;
+        int pngCompressionLevel = Utils::ProgramOptions::pngCompressionLevel;
+        int jpegQuality = Utils::ProgramOptions::jpegQuality;
+        std::string outputFormat = Utils::ProgramOptions::outputFormat;
+        int threads = Utils::ProgramOptions::threads;
+        bool verbose = Utils::ProgramOptions::verbose;
+
+        void restore() const {
+            Utils::ProgramOptions::errorMethod = errorMethod;
+            Utils::ProgramOptions::threshold = threshold;
+            Utils::ProgramOptions::minBlockSize = minBlockSize;
+            Utils::ProgramOptions::targetCompressionRatio = targetCompressionRatio;
+            Utils::ProgramOptions::pngCompressionLevel = pngCompressionLevel;
+            Utils::ProgramOptions::jpegQuality = jpegQuality;
+            Utils::ProgramOptions::outputFormat = outputFormat;
+            Utils::ProgramOptions::threads = threads;
+            Utils::ProgramOptions::verbose = verbose;
+        }
+    };
+
+    // Runs one request through the same steps as the command-line program
+    void compress(const Request& request, const SharedOptions& defaults, const ResultCache& daemonCache,
+                  QuadTreeCompressor& compressor, long long requestId, Response& response) {
+        defaults.restore();
+
+        std::vector<std::string> args(1, "serve");
+        args.insert(args.end(), request.args.begin(), request.args.end());
+        std::vector<char*> argv;
+        for (std::string& arg : args) argv.push_back(&arg[0]);
+        Utils::ProgramOptions options = Utils::parseCommandLineArgs(static_cast<int>(argv.size()), argv.data());
+
+        if (!request.hasData && options.inputFile.empty() && options.shmInput.empty()) {
+            response.message = "no input: send --input, --shm-input or a data block";
+            return;
+        }
+        if (options.inputFile == "-" || options.outputFile == "-") {
+            response.message = "the daemon has no standard input or output for \"-\"; use --inline";
+            return;
+        }
+        if (options.outputFile.empty() && (request.returnData || options.shmOutput.empty())) {
+            response.message = "no output: send --shm-output or --output, whose extension selects the format";
+            return;
+        }
+
+        std::vector<std::vector<RGB>> image;
+        try {
+            Stats::ScopedPhase phase("decode");
+            if (request.hasData) {
+                image = ImageProcessor::loadImageFromMemory(
+                    reinterpret_cast<const unsigned char*>(request.data.data()), request.data.size());
+            } else if (!options.inputFile.empty()) {
+                image = ImageProcessor::loadImage(options.inputFile);
+            } else {
+                image = SharedImage::load(options.shmInput);
+            }
+        } catch (const std::exception& e) {
+            Metrics::recordError("decode");
+            response.message = e.what();
+            return;
+        }
+        int imageWidth = image[0].size();
+        int imageHeight = image.size();
+
+        // GIF frames are written while the tree is built, so those requests always build
+        const ResultCache noCache("", 0);
+        const ResultCache& cache = options.gifFile.empty() ? daemonCache : noCache;
+        std::string cacheKey;
+        QuadTree tree(imageWidth, imageHeight);
+        bool cacheHit = false;
+        if (cache.enabled()) {
+            Stats::ScopedPhase phase("cache_lookup");
+            cacheKey = ResultCache::makeKey(image, options.errorMethod, options.threshold, options.minBlockSize,
+                                            options.targetCompressionRatio);
+            double cachedThreshold = 0;
+            cacheHit = cache.loadTree(cacheKey, tree, cachedThreshold);
+            if (cacheHit) {
+                Utils::ProgramOptions::threshold = cachedThreshold;
+            }
+        }
+
+        if (!cacheHit && options.targetCompressionRatio > 0) {
+            Stats::ScopedPhase phase("target_ratio_search");
+            double adjustedThreshold = compressor.adjustThresholdForTargetRatio(
+                image, options.targetCompressionRatio, options.threshold, options.errorMethod, options.minBlockSize);
+            Utils::ProgramOptions::errorMethod = options.errorMethod;
+            Utils::ProgramOptions::minBlockSize = options.minBlockSize;
+            Utils::ProgramOptions::threshold = adjustedThreshold;
+        }
+
+        GifGenerator::AnimationWriter gifWriter;
+        bool gifWritten = false;
+        QuadTree::LevelCallback onLevelComplete;
+        if (!options.gifFile.empty()) {
+            gifWritten = gifWriter.begin(options.gifFile, imageWidth, imageHeight);
+            if (gifWritten) {
+                Stats::ScopedPhase palettePhase("gif");
+                gifWriter.fixPalette(image);
+                palettePhase.stop();
+                onLevelComplete = [&gifWriter, &gifWritten](int, const std::vector<QuadTreeNode*>& nodes) {
+                    Stats::ScopedPhase phase("gif");
+                    gifWritten = gifWriter.writeLevel(nodes) && gifWritten;
+                };
+            }
+        }
+
+        // Exclusive build time, as in the command-line program
+        double buildMsBefore = phaseWallMs("build");
+        if (!cacheHit) {
+            Stats::ScopedPhase buildPhase("build");
+            tree = compressor.compressImage(image, Utils::ProgramOptions::threshold, options.errorMethod, onLevelComplete);
+            buildPhase.stop();
+            cache.storeTree(cacheKey, tree, Utils::ProgramOptions::threshold);
+        }
+        double buildMs = phaseWallMs("build") - buildMsBefore;
+
+        if (!options.gifFile.empty()) {
+            Stats::ScopedPhase phase("gif");
+            if (!(gifWriter.finish(tree) && gifWritten)) {
+                Metrics::recordError("gif");
+                response.message = "failed to write GIF: " + options.gifFile;
+                return;
+            }
+        }
+
+        // Shared-memory frames are raw RGB
+        long long rawFrameSize = static_cast<long long>(imageWidth) * imageHeight * 3;
+        long long outputBytes = rawFrameSize;
+        if (!options.shmOutput.empty() && !SharedImage::save(tree, options.shmOutput)) {
+            Metrics::recordError("save");
+            response.message = "failed to write shared memory: " + options.shmOutput;
+            return;
+        }
+
+        if (!options.outputFile.empty()) {
+            // Returned images go through a temporary file with the requested extension
+            std::string outputFile = options.outputFile;
+            if (request.returnData) {
+                const char* directory = std::getenv("TMPDIR");
+                std::ostringstream name;
+                name << (directory && *directory ? directory : "/tmp") << "/quadtree-serve-" << getpid() << "-"
+                     << requestId << "." << Utils::getFileExtension(options.outputFile);
+                outputFile = name.str();
+            }
+
+            bool fromCache = cacheHit && cache.loadOutput(cacheKey, outputFile, options.quantizePalette);
+            if (!fromCache && !ImageProcessor::saveImage(tree, outputFile, options.quantizePalette)) {
+                Metrics::recordError("save");
+                std::remove(outputFile.c_str());
+                response.message = "failed to save output image: " + options.outputFile;
+                return;
+            }
+            if (!fromCache) {
+                cache.storeOutput(cacheKey, outputFile, options.quantizePalette);
+            }
+            outputBytes = fileSize(outputFile);
+
+            if (request.returnData) {
+                std::ifstream file(outputFile, std::ios::binary);
+                std::ostringstream bytes;
+                bytes << file.rdbuf();
+                response.data = bytes.str();
+                response.hasData = true;
+                std::remove(outputFile.c_str());
+            }
+        }
+
+        if (!options.costMapFile.empty() && !CostMap::save(tree, Utils::ProgramOptions::threshold, options.costMapFile)) {
+            std::cerr << "Error: Failed to save cost map.\n";
+        }
+
+        long long inputBytes = request.hasData ? static_cast<long long>(request.data.size())
+                             : options.inputFile.empty() ? rawFrameSize : fileSize(options.inputFile);
+        Metrics::recordImage(options.errorMethod, inputBytes, outputBytes, buildMs / 1000.0);
+
+        response.ok = true;
+        if (!options.outputFile.empty() && !request.returnData) response.fields.push_back({"output", options.outputFile});
+        if (!options.shmOutput.empty()) response.fields.push_back({"shm_output", options.shmOutput});
+        response.fields.push_back({"width", std::to_string(imageWidth)});
+        response.fields.push_back({"height", std::to_string(imageHeight)});
+        response.fields.push_back({"threshold", std::to_string(Utils::ProgramOptions::threshold)});
+        response.fields.push_back({"nodes", std::to_string(tree.getNodeCount())});
+        response.fields.push_back({"leaves", std::to_string(tree.getLeafCount())});
+        response.fields.push_back({"depth", std::to_string(tree.getDepth())});
+        response.fields.push_back({"build_ms", std::to_string(buildMs)});
+        response.fields.push_back({"output_bytes", std::to_string(outputBytes)});
+        if (cache.enabled()) response.fields.push_back({"cache", cacheHit ? "hit" : "miss"});
+    }
+
+    // Connections accepted by the main thread and not yet picked up by the worker
+    struct RequestQueue {
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<int> connections;
+        bool closed = false;
+    };
+
+    void runWorker(RequestQueue& queue, const SharedOptions& defaults, const ResultCache& cache,
+                   QuadTreeCompressor& compressor, const std::string& metricsFile,
+                   std::atomic<bool>& shutdownRequested) {
+        long long requestId = 0;
+        for (;;) {
+            int fd;
+            {
+                std::unique_lock<std::mutex> lock(queue.mutex);
+                queue.ready.wait(lock, [&queue]() { return queue.closed || !queue.connections.empty(); });
+                if (queue.connections.empty()) return;
+                fd = queue.connections.front();
+                queue.connections.pop_front();
+                Metrics::setQueueDepth(static_cast<long long>(queue.connections.size()));
+            }
+
+            Connection connection(fd);
+            Request request;
+            Response response;
+            std::string error;
+            ++requestId;
+            auto start = std::chrono::steady_clock::now();
+
+            if (!readRequest(connection, request, error)) {
+                response.message = error;
+                Metrics::recordError("request");
+            } else if (request.shutdown) {
+                response.ok = true;
+                shutdownRequested = true;
+            } else {
+                try {
+                    compress(request, defaults, cache, compressor, requestId, response);
+                } catch (const std::exception& e) {
+                    Metrics::recordError("exception");
+                    response.message = e.what();
+                }
+            }
+            writeResponse(connection, response);
+
+            double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "[serve] request " << requestId << ": " << (response.ok ? "ok" : "error " + response.message)
+                      << " (" << static_cast<long long>(elapsedMs) << " ms)" << std::endl;
+
+            if (!metricsFile.empty() && !Metrics::writeTextfile(metricsFile)) {
+                std::cerr << "Error: Failed to write metrics to: " << metricsFile << "\n";
+            }
+        }
+    }
+
+    bool makeAddress(const std::string& socketPath, sockaddr_un& address) {
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path)) {
+            std::cerr << "Error: Socket path must be 1-" << sizeof(address.sun_path) - 1 << " characters: "
+                      << socketPath << "\n";
+            return false;
+        }
+        std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+        return true;
+    }
+
+    int connectTo(const sockaddr_un& address) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    int createListener(const std::string& socketPath) {
+        sockaddr_un address;
+        if (!makeAddress(socketPath, address)) return -1;
+
+        // A socket left behind by a daemon that died is replaced; a live daemon or any other file is not
+        struct stat existing;
+        if (lstat(socketPath.c_str(), &existing) == 0) {
+            int probe = connectTo(address);
+            if (probe >= 0) {
+                close(probe);
+                std::cerr << "Error: A daemon is already serving on " << socketPath << "\n";
+                return -1;
+            }
+            if (!S_ISSOCK(existing.st_mode)) {
+                std::cerr << "Error: " << socketPath << " exists and is not a socket\n";
+                return -1;
+            }
+            unlink(socketPath.c_str());
+        }
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, 64) != 0) {
+            std::cerr << "Error: Cannot listen on " << socketPath << ": " << std::strerror(errno) << "\n";
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    std::string absolutePath(const std::string& path) {
+        if (path.empty() || path[0] == '/') return path;
+        char directory[4096];
+        if (!getcwd(directory, sizeof(directory))) return path;
+        return std::string(directory) + "/" + path;
+    }
+}
+
+namespace Server {
+    int serve(const std::string& socketPath, const std::string& metricsFile, const ResultCache& cache,
+              QuadTreeCompressor& compressor) {
+        int listener = createListener(socketPath);
+        if (listener < 0) return 1;
+
+        SharedOptions defaults;
+        RequestQueue queue;
+        std::atomic<bool> shutdownRequested(false);
+
+        // Replies to a client that went away must not kill the daemon
+        signal(SIGPIPE, SIG_IGN);
+
+        // The worker is started with SIGINT and SIGTERM blocked so they interrupt the accept loop instead
+        struct sigaction action;
+        std::memset(&action, 0, sizeof(action));
+        action.sa_handler = onSignal;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+
+        sigset_t stopSignals, previousMask;
+        sigemptyset(&stopSignals);
+        sigaddset(&stopSignals, SIGINT);
+        sigaddset(&stopSignals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &stopSignals, &previousMask);
+        std::thread worker(runWorker, std::ref(queue), std::cref(defaults), std::cref(cache), std::ref(compressor),
+                           std::cref(metricsFile), std::ref(shutdownRequested));
+        pthread_sigmask(SIG_SETMASK, &previousMask, nullptr);
+
+        std::cout << "Serving on " << socketPath << " (stop with Ctrl+C or a shutdown request)" << std::endl;
+        if (!metricsFile.empty()) {
+            Metrics::setQueueDepth(0);
+            Metrics::writeTextfile(metricsFile);
+        }
+
+        // Polling with a timeout lets a shutdown request from the worker end the loop
+        while (!signalled && !shutdownRequested) {
+            pollfd waiting = {listener, POLLIN, 0};
+            int ready = poll(&waiting, 1, 250);
+            if (ready <= 0) continue;
+
+            int connection = accept(listener, nullptr, nullptr);
+            if (connection < 0) continue;
+
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.connections.push_back(connection);
+            Metrics::setQueueDepth(static_cast<long long>(queue.connections.size()));
+            queue.ready.notify_one();
+        }
+
+        // Requests already accepted are still answered
+        close(listener);
+        unlink(socketPath.c_str());
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.closed = true;
+        }
+        queue.ready.notify_one();
+        worker.join();
+
+        std::cout << "Server stopped." << std::endl;
+        return 0;
+    }
+
+    int runClient(const std::string& socketPath, int argc, char* argv[]) {
+        bool sendData = false;
+        bool shutdown = false;
+        std::vector<std::string> args;
+        std::string inputFile, outputFile;
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--client" && i + 1 < argc) {
+                ++i;
+            } else if (arg == "--inline") {
+                sendData = true;
+            } else if (arg == "--shutdown") {
+                shutdown = true;
+            } else if ((arg == "--input" || arg == "--output" || arg == "--gif" || arg == "--cost-map") && i + 1 < argc) {
+                // The daemon has its own working directory
+                std::string path = absolutePath(Utils::normalizePath(argv[++i]));
+                if (arg == "--input") inputFile = path;
+                if (arg == "--output") outputFile = path;
+                args.push_back(arg);
+                args.push_back(path);
+            } else {
+                args.push_back(arg);
+            }
+        }
+
+        std::ostringstream request;
+        if (shutdown) {
+            request << "shutdown\n";
+        } else {
+            for (size_t i = 0; i < args.size(); ++i) {
+                // Inline input replaces the path, which the daemon may not be able to read
+                if (sendData && args[i] == "--input") {
+                    ++i;
+                    continue;
+                }
+                request << "arg " << args[i] << "\n";
+            }
+            if (sendData) {
+                std::ifstream file(inputFile, std::ios::binary);
+                if (inputFile.empty() || !file.is_open()) {
+                    std::cerr << "Error: --inline needs a readable --input file\n";
+                    return 1;
+                }
+                std::ostringstream bytes;
+                bytes << file.rdbuf();
+                request << "data " << bytes.str().size() << "\n" << bytes.str() << "return-data\n";
+            }
+        }
+        request << "end\n";
+
+        sockaddr_un address;
+        if (!makeAddress(socketPath, address)) return 1;
+        int fd = connectTo(address);
+        if (fd < 0) {
+            std::cerr << "Error: Cannot connect to " << socketPath << ": " << std::strerror(errno) << "\n";
+            return 1;
+        }
+        signal(SIGPIPE, SIG_IGN);
+
+        Connection connection(fd);
+        if (!connection.write(request.str())) {
+            std::cerr << "Error: Failed to send the request\n";
+            return 1;
+        }
+
+        bool ok = false;
+        std::string line;
+        while (connection.readLine(line)) {
+            if (line == "end") return ok ? 0 : 1;
+            if (line == "ok") {
+                ok = true;
+            } else if (line.compare(0, 5, "data ") == 0) {
+                size_t size;
+                std::string bytes;
+                if (!parseSize(line.substr(5), size) || !connection.readBytes(size, bytes)) break;
+                std::ofstream file(outputFile, std::ios::binary);
+                if (!file.write(bytes.data(), bytes.size())) {
+                    std::cerr << "Error: Cannot write " << outputFile << "\n";
+                    return 1;
+                }
+                std::cout << "output " << outputFile << "\n";
+                continue;
+            }
+            std::cout << line << "\n";
+        }
+        std::cerr << "Error: Connection closed before the reply was complete\n";
+        return 1;
+    }
+}
+#else
+namespace Server {
+    int serve(const std::string&, const std::string&, const ResultCache&, QuadTreeCompressor&) {
+        std::cerr << "Error: --serve needs Unix domain sockets and is not available on Windows\n";
+        return 1;
+    }
+
+    int runClient(const std::string&, int, char*[]) {
+        std::cerr << "Error: --client needs Unix domain sockets and is not available on Windows\n";
+        return 1;
+    }
+}
+#endif
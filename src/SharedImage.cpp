@@ -0,0 +1,121 @@
+#include "SharedImage.hpp"
+#include "Stats.hpp"
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(RGB) == 3, "shared-memory rows are copied as packed RGB triples");
+
+#ifndef _WIN32
+namespace {
+    std::string segmentName(const std::string& name) {
+        return name.empty() || name[0] == '/' ? name : "/" + name;
+    }
+
+    // Unmaps and closes on scope exit
+    struct Mapping {
+        int fd = -1;
+        void* address = MAP_FAILED;
+        size_t size = 0;
+
+        ~Mapping() {
+            if (address != MAP_FAILED) munmap(address, size);
+            if (fd >= 0) close(fd);
+        }
+    };
+}
+
+namespace SharedImage {
+    std::vector<std::vector<RGB>> load(const std::string& name) {
+        std::string segment = segmentName(name);
+        Mapping mapping;
+        mapping.fd = shm_open(segment.c_str(), O_RDONLY, 0);
+        struct stat info;
+        if (mapping.fd < 0 || fstat(mapping.fd, &info) != 0) {
+            throw std::runtime_error("Failed to open shared memory " + segment + ": " + std::strerror(errno));
+        }
+
+        mapping.size = static_cast<size_t>(info.st_size);
+        if (mapping.size < sizeof(Header)) {
+            throw std::runtime_error("Shared memory " + segment + " is smaller than its header");
+        }
+        mapping.address = mmap(nullptr, mapping.size, PROT_READ, MAP_SHARED, mapping.fd, 0);
+        if (mapping.address == MAP_FAILED) {
+            throw std::runtime_error("Failed to map shared memory " + segment + ": " + std::strerror(errno));
+        }
+
+        Header header;
+        std::memcpy(&header, mapping.address, sizeof(header));
+        if (header.magic != MAGIC || header.width == 0 || header.height == 0 ||
+            header.stride < 3ull * header.width ||
+            mapping.size - sizeof(Header) < static_cast<unsigned long long>(header.stride) * header.height) {
+            throw std::runtime_error("Shared memory " + segment + " does not hold a valid frame");
+        }
+
+        static Stats::AllocationSite site("image_buffers");
+        Stats::AllocationScope allocations(site);
+        std::vector<std::vector<RGB>> image(header.height, std::vector<RGB>(header.width));
+
+        const uint8_t* pixels = static_cast<const uint8_t*>(mapping.address) + sizeof(Header);
+        for (uint32_t y = 0; y < header.height; ++y) {
+            std::memcpy(image[y].data(), pixels + static_cast<size_t>(y) * header.stride, 3 * header.width);
+        }
+
+        std::cout << "Loaded shared memory frame: " << segment << " (" << header.width << "x" << header.height << ")" << std::endl;
+        return image;
+    }
+
+    bool save(const QuadTree& tree, const std::string& name) {
+        const QuadTreeNode* root = tree.getRoot();
+        if (!root || root->getBlockWidth() <= 0 || root->getBlockHeight() <= 0) {
+            std::cerr << "Error: Cannot save empty image" << std::endl;
+            return false;
+        }
+
+        std::string segment = segmentName(name);
+        Header header = {MAGIC, static_cast<uint32_t>(root->getBlockWidth()),
+                         static_cast<uint32_t>(root->getBlockHeight()),
+                         static_cast<uint32_t>(3 * root->getBlockWidth())};
+
+        Mapping mapping;
+        mapping.size = sizeof(Header) + static_cast<size_t>(header.stride) * header.height;
+        mapping.fd = shm_open(segment.c_str(), O_RDWR | O_CREAT, 0600);
+        if (mapping.fd < 0 || ftruncate(mapping.fd, static_cast<off_t>(mapping.size)) != 0) {
+            std::cerr << "Error: Failed to create shared memory " << segment << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        mapping.address = mmap(nullptr, mapping.size, PROT_READ | PROT_WRITE, MAP_SHARED, mapping.fd, 0);
+        if (mapping.address == MAP_FAILED) {
+            std::cerr << "Error: Failed to map shared memory " << segment << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+
+        std::memcpy(mapping.address, &header, sizeof(header));
+
+        Stats::ScopedPhase phase("render");
+        tree.renderInto(static_cast<uint8_t*>(mapping.address) + sizeof(Header), header.stride);
+
+        std::cout << "Rendered to shared memory: " << segment << " (" << header.width << "x" << header.height << ")" << std::endl;
+        return true;
+    }
+}
+#else
+namespace SharedImage {
+    std::vector<std::vector<RGB>> load(const std::string&) {
+        throw std::runtime_error("Shared memory input needs POSIX shm_open and is not available on Windows");
+    }
+
+    bool save(const QuadTree&, const std::string&) {
+        std::cerr << "Error: Shared memory output needs POSIX shm_open and is not available on Windows" << std::endl;
+        return false;
+    }
+}
+#endif
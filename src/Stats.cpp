@@ -0,0 +1,274 @@
+#include "Stats.hpp"
+#include "Utils.hpp"
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+    std::atomic<long long> allocations(0);
+    std::atomic<long long> allocatedBytes(0);
+
+    thread_local Stats::ScopedPhase* currentPhase = nullptr;
+    thread_local Stats::AllocationSite* currentSite = nullptr;
+
+    struct Registry {
+        std::mutex mutex;
+        std::vector<Stats::Phase> phases;
+        std::vector<std::pair<std::string, long long>> counters;
+        std::vector<Stats::AllocationSite*> sites;
+    };
+
+    Registry& registry() {
+        static Registry instance;
+        return instance;
+    }
+}
+
+#ifdef QUADTREE_ALLOCATION_STATS
+// Global allocation counting; everything else is left to malloc/free
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(static_cast<long long>(size), std::memory_order_relaxed);
+    if (Stats::AllocationSite* site = currentSite) {
+        site->allocations.fetch_add(1, std::memory_order_relaxed);
+        site->bytes.fetch_add(static_cast<long long>(size), std::memory_order_relaxed);
+    }
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+#endif
+
+namespace Stats {
+    ScopedPhase::ScopedPhase(const char* name)
+        : name(name), running(true), parent(currentPhase), wallStart(std::chrono::steady_clock::now()),
+          cpuStart(processCpuMs()), nestedWallMs(0), nestedCpuMs(0),
+          allocationsStart(allocationCount()), bytesStart(allocatedBytes()), nestedAllocations(0), nestedBytes(0),
+          trace(name, "phase") {
+        currentPhase = this;
+    }
+
+    ScopedPhase::~ScopedPhase() {
+        stop();
+    }
+
+    void ScopedPhase::stop() {
+        if (!running) return;
+        running = false;
+        trace.end();
+
+        double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+        double cpuMs = processCpuMs() - cpuStart;
+        long long phaseAllocations = allocationCount() - allocationsStart;
+        long long phaseBytes = allocatedBytes() - bytesStart;
+
+        currentPhase = parent;
+        if (parent) {
+            parent->nestedWallMs += wallMs;
+            parent->nestedCpuMs += cpuMs;
+            parent->nestedAllocations += phaseAllocations;
+            parent->nestedBytes += phaseBytes;
+        }
+        addPhaseTime(name, wallMs - nestedWallMs, cpuMs - nestedCpuMs,
+                     phaseAllocations - nestedAllocations, phaseBytes - nestedBytes);
+    }
+
+    void ScopedPhase::exclude(double wallMs, double cpuMs) {
+        nestedWallMs += wallMs;
+        nestedCpuMs += cpuMs;
+    }
+
+    void addPhaseTime(const std::string& name, double wallMs, double cpuMs,
+                      long long allocations, long long allocatedBytes) {
+        Registry& stats = registry();
+        std::lock_guard<std::mutex> lock(stats.mutex);
+        for (Phase& phase : stats.phases) {
+            if (phase.name == name) {
+                phase.wallMs += wallMs;
+                phase.cpuMs += cpuMs;
+                ++phase.calls;
+                phase.allocations += allocations;
+                phase.allocatedBytes += allocatedBytes;
+                return;
+            }
+        }
+        stats.phases.push_back({name, wallMs, cpuMs, 1, allocations, allocatedBytes});
+    }
+
+    AllocationSite::AllocationSite(const char* name) : name(name), allocations(0), bytes(0) {
+        Registry& stats = registry();
+        std::lock_guard<std::mutex> lock(stats.mutex);
+        stats.sites.push_back(this);
+    }
+
+    AllocationScope::AllocationScope(AllocationSite& site) : previous(currentSite) {
+        currentSite = &site;
+    }
+
+    AllocationScope::~AllocationScope() {
+        currentSite = previous;
+    }
+
+    std::vector<SiteUsage> getAllocationSites() {
+        Registry& stats = registry();
+        std::lock_guard<std::mutex> lock(stats.mutex);
+        std::vector<SiteUsage> usage;
+        for (const AllocationSite* site : stats.sites) {
+            auto entry = std::find_if(usage.begin(), usage.end(),
+                                      [site](const SiteUsage& u) { return u.name == site->name; });
+            if (entry == usage.end()) {
+                usage.push_back({site->name, 0, 0});
+                entry = usage.end() - 1;
+            }
+            entry->allocations += site->allocations.load(std::memory_order_relaxed);
+            entry->bytes += site->bytes.load(std::memory_order_relaxed);
+        }
+        return usage;
+    }
+
+    std::vector<Phase> getPhases() {
+        Registry& stats = registry();
+        std::lock_guard<std::mutex> lock(stats.mutex);
+        return stats.phases;
+    }
+
+    void addCounter(const std::string& name, long long value) {
+        Registry& stats = registry();
+        std::lock_guard<std::mutex> lock(stats.mutex);
+        for (auto& counter : stats.counters) {
+            if (counter.first == name) {
+                counter.second += value;
+                return;
+            }
+        }
+        stats.counters.push_back(std::make_pair(name, value));
+    }
+
+    std::vector<std::pair<std::string, long long>> getCounters() {
+        Registry& stats = registry();
+        std::lock_guard<std::mutex> lock(stats.mutex);
+        return stats.counters;
+    }
+
+    double processCpuMs() {
+#ifdef _WIN32
+        return 1000.0 * std::clock() / CLOCKS_PER_SEC;
+#else
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+               (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+#endif
+    }
+
+    long long peakResidentKB() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+        return static_cast<long long>(counters.PeakWorkingSetSize / 1024);
+#else
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;  // Kilobytes on Linux
+#endif
+    }
+
+    bool allocationTrackingEnabled() {
+#ifdef QUADTREE_ALLOCATION_STATS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    long long allocationCount() {
+        return allocations.load(std::memory_order_relaxed);
+    }
+
+    long long allocatedBytes() {
+        return ::allocatedBytes.load(std::memory_order_relaxed);
+    }
+
+    bool writeJson(const std::string& filename,
+                   const std::vector<std::pair<std::string, std::string>>& info,
+                   double totalWallMs) {
+        std::ofstream file(filename);
+        if (!file.is_open()) return false;
+
+        file << std::fixed << std::setprecision(3);
+        file << "{\n";
+        for (const auto& field : info) {
+            file << "  \"" << Utils::escapeJson(field.first) << "\": \"" << Utils::escapeJson(field.second) << "\",\n";
+        }
+        file << "  \"total_wall_ms\": " << totalWallMs << ",\n";
+        file << "  \"cpu_ms\": " << processCpuMs() << ",\n";
+
+        file << "  \"phases\": {";
+        std::vector<Phase> phases = getPhases();
+        for (size_t i = 0; i < phases.size(); ++i) {
+            file << (i ? ",\n" : "\n") << "    \"" << Utils::escapeJson(phases[i].name) << "\": {"
+                 << "\"wall_ms\": " << phases[i].wallMs << ", "
+                 << "\"cpu_ms\": " << phases[i].cpuMs << ", "
+                 << "\"calls\": " << phases[i].calls << ", "
+                 << "\"allocations\": " << phases[i].allocations << ", "
+                 << "\"allocated_bytes\": " << phases[i].allocatedBytes << "}";
+        }
+        file << (phases.empty() ? "},\n" : "\n  },\n");
+
+        file << "  \"counters\": {";
+        std::vector<std::pair<std::string, long long>> counters = getCounters();
+        for (size_t i = 0; i < counters.size(); ++i) {
+            file << (i ? ",\n" : "\n") << "    \"" << Utils::escapeJson(counters[i].first) << "\": " << counters[i].second;
+        }
+        file << (counters.empty() ? "},\n" : "\n  },\n");
+
+        // Allocation counts cover operator new only; stb_image and gif.h use malloc directly
+        file << "  \"memory\": {\n"
+             << "    \"peak_rss_kb\": " << peakResidentKB() << ",\n"
+             << "    \"allocation_tracking\": " << (allocationTrackingEnabled() ? "true" : "false") << ",\n"
+             << "    \"allocations\": " << allocationCount() << ",\n"
+             << "    \"allocated_bytes\": " << allocatedBytes() << ",\n"
+             << "    \"sites\": {";
+        std::vector<SiteUsage> sites = getAllocationSites();
+        for (size_t i = 0; i < sites.size(); ++i) {
+            file << (i ? ",\n" : "\n") << "      \"" << Utils::escapeJson(sites[i].name) << "\": {"
+                 << "\"allocations\": " << sites[i].allocations << ", "
+                 << "\"allocated_bytes\": " << sites[i].bytes << "}";
+        }
+        file << (sites.empty() ? "}\n" : "\n    }\n");
+        file << "  }\n";
+        file << "}\n";
+        return file.good();
+    }
+}
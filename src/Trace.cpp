@@ -0,0 +1,133 @@
+#include "Trace.hpp"
+#include "Utils.hpp"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+
+namespace {
+    struct Event {
+        const char* name;
+        const char* category;
+        double startUs;
+        double durationUs;
+        int thread;
+        int argCount;
+        std::pair<const char*, long long> args[Trace::Scope::MAX_ARGS];
+    };
+
+    struct Recorder {
+        std::atomic<bool> enabled{false};
+        std::chrono::steady_clock::time_point epoch;
+        std::atomic<int> nextThread{1};
+        std::mutex mutex;
+        std::vector<Event> events;
+        std::vector<std::pair<int, std::string>> threadNames;
+    };
+
+    Recorder& recorder() {
+        static Recorder instance;
+        return instance;
+    }
+
+    // Small sequential ids read better in the viewer than native thread ids
+    int currentThread() {
+        thread_local int id = recorder().nextThread.fetch_add(1);
+        return id;
+    }
+
+    double nowUs() {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - recorder().epoch).count();
+    }
+
+    // Event names and categories are string literals, so they need no escaping
+    void writeArgs(std::ofstream& file, const Event& event) {
+        file << ", \"args\": {";
+        for (int i = 0; i < event.argCount; ++i) {
+            file << (i ? ", " : "") << "\"" << event.args[i].first << "\": " << event.args[i].second;
+        }
+        file << "}";
+    }
+}
+
+namespace Trace {
+    void enable() {
+        Recorder& trace = recorder();
+        trace.epoch = std::chrono::steady_clock::now();
+        trace.enabled = true;
+    }
+
+    bool isEnabled() {
+        return recorder().enabled.load(std::memory_order_relaxed);
+    }
+
+    Scope::Scope(const char* name, const char* category, bool record)
+        : name(name), category(category), active(record && isEnabled()), startUs(0), argCount(0) {
+        if (active) startUs = nowUs();
+    }
+
+    Scope::~Scope() {
+        end();
+    }
+
+    void Scope::end() {
+        if (!active) return;
+        active = false;
+
+        Event event;
+        event.name = name;
+        event.category = category;
+        event.startUs = startUs;
+        event.durationUs = nowUs() - startUs;
+        event.thread = currentThread();
+        event.argCount = argCount;
+        for (int i = 0; i < argCount; ++i) event.args[i] = args[i];
+
+        Recorder& trace = recorder();
+        std::lock_guard<std::mutex> lock(trace.mutex);
+        trace.events.push_back(event);
+    }
+
+    Scope& Scope::arg(const char* key, long long value) {
+        if (active && argCount < MAX_ARGS) args[argCount++] = std::make_pair(key, value);
+        return *this;
+    }
+
+    void setThreadName(const std::string& name) {
+        if (!isEnabled()) return;
+
+        Recorder& trace = recorder();
+        int thread = currentThread();
+        std::lock_guard<std::mutex> lock(trace.mutex);
+        trace.threadNames.push_back(std::make_pair(thread, name));
+    }
+
+    bool writeJson(const std::string& filename) {
+        std::ofstream file(filename);
+        if (!file.is_open()) return false;
+
+        Recorder& trace = recorder();
+        std::lock_guard<std::mutex> lock(trace.mutex);
+
+        file << std::fixed << std::setprecision(3);
+        file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        for (const auto& thread : trace.threadNames) {
+            file << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+                 << thread.first << ", \"args\": {\"name\": \"" << Utils::escapeJson(thread.second) << "\"}}";
+            first = false;
+        }
+        for (const Event& event : trace.events) {
+            file << (first ? "" : ",\n") << "{\"name\": \"" << event.name << "\", \"cat\": \"" << event.category
+                 << "\", \"ph\": \"X\", \"ts\": " << event.startUs << ", \"dur\": " << event.durationUs
+                 << ", \"pid\": 1, \"tid\": " << event.thread;
+            writeArgs(file, event);
+            file << "}";
+            first = false;
+        }
+        file << "\n]}\n";
+        return file.good();
+    }
+}
@@ -4,11 +4,15 @@
 #include <iomanip>
 #include <algorithm>
 #include <iostream>
+#include <atomic>
+#include <cstdio>
 #include <sys/stat.h>
 
 #ifdef _WIN32
 #include <direct.h>
+#include <process.h>
 #define MKDIR(dir) _mkdir(dir)
+#define getpid _getpid
 #else
 #include <unistd.h>
 #define MKDIR(dir) mkdir(dir, 0755)
@@ -19,6 +23,12 @@ namespace Utils {
     int ProgramOptions::minBlockSize = 1;
     double ProgramOptions::threshold = 100.0;
     double ProgramOptions::targetCompressionRatio = 0.0;
+    int ProgramOptions::pngCompressionLevel = 6;
+    int ProgramOptions::jpegQuality = 90;
+    std::string ProgramOptions::outputFormat = "png";
+    int ProgramOptions::threads = 0;
+    int ProgramOptions::traceMinBlock = 64;
+    bool ProgramOptions::verbose = false;
 
     // File operations
     bool fileExists(const std::string& filename) {
@@ -87,6 +97,12 @@ namespace Utils {
         return (result == 0 || errno == EEXIST);
     }
 
+    std::string temporaryPath(const std::string& file) {
+        // Unique per process and call, so concurrent writers of one file never share a name
+        static std::atomic<long long> counter(0);
+        return file + ".tmp-" + std::to_string(static_cast<long long>(getpid())) + "-" + std::to_string(counter++);
+    }
+
     ProgramOptions parseCommandLineArgs(int argc, char* argv[]) {
         ProgramOptions options;
 
@@ -98,6 +114,43 @@ namespace Utils {
                 options.outputFile = normalizePath(argv[++i]);
             } else if (arg == "--gif" && i + 1 < argc) {
                 options.gifFile = normalizePath(argv[++i]);
+            } else if (arg == "--threads" && i + 1 < argc) {
+                options.threads = std::max(0, std::stoi(argv[++i]));
+            } else if (arg == "--stats-json" && i + 1 < argc) {
+                options.statsFile = normalizePath(argv[++i]);
+            } else if (arg == "--cost-map" && i + 1 < argc) {
+                options.costMapFile = normalizePath(argv[++i]);
+            } else if (arg == "--metrics" && i + 1 < argc) {
+                options.metricsFile = normalizePath(argv[++i]);
+            } else if (arg == "--shm-input" && i + 1 < argc) {
+                options.shmInput = argv[++i];
+            } else if (arg == "--shm-output" && i + 1 < argc) {
+                options.shmOutput = argv[++i];
+            } else if (arg == "--batch" && i + 1 < argc) {
+                options.batchFile = normalizePath(argv[++i]);
+            } else if (arg == "--output-dir" && i + 1 < argc) {
+                options.outputDir = normalizePath(argv[++i]);
+            } else if (arg == "--jobs" && i + 1 < argc) {
+                options.jobs = std::max(0, std::stoi(argv[++i]));
+            } else if (arg == "--memory-budget" && i + 1 < argc) {
+                options.memoryBudgetMB = std::max(0LL, std::stoll(argv[++i]));
+            } else if (arg == "--cache-dir" && i + 1 < argc) {
+                options.cacheDir = normalizePath(argv[++i]);
+            } else if (arg == "--cache-size" && i + 1 < argc) {
+                options.cacheSizeMB = std::max(1LL, std::stoll(argv[++i]));
+            } else if (arg == "--annotate") {
+                options.annotate = true;
+            } else if (arg == "--annotation-dir" && i + 1 < argc) {
+                options.annotationDir = normalizePath(argv[++i]);
+                options.annotate = true;
+            } else if (arg == "--serve" && i + 1 < argc) {
+                options.serveSocket = normalizePath(argv[++i]);
+            } else if (arg == "--client" && i + 1 < argc) {
+                options.clientSocket = normalizePath(argv[++i]);
+            } else if (arg == "--trace" && i + 1 < argc) {
+                options.traceFile = normalizePath(argv[++i]);
+            } else if (arg == "--trace-min-block" && i + 1 < argc) {
+                options.traceMinBlock = std::max(1, std::stoi(argv[++i]));
             } else if (arg == "--error-method" && i + 1 < argc) {
                 options.errorMethod = argv[++i];
             } else if (arg == "--threshold" && i + 1 < argc) {
@@ -106,8 +159,18 @@ namespace Utils {
                 options.minBlockSize = std::stoi(argv[++i]);
             } else if (arg == "--target-ratio" && i + 1 < argc) {
                 options.targetCompressionRatio = std::stod(argv[++i]);
+            } else if (arg == "--png-level" && i + 1 < argc) {
+                options.pngCompressionLevel = clamp(std::stoi(argv[++i]), 1, 9);
+            } else if (arg == "--jpeg-quality" && i + 1 < argc) {
+                options.jpegQuality = clamp(std::stoi(argv[++i]), 1, 100);
+            } else if (arg == "--output-format" && i + 1 < argc) {
+                options.outputFormat = argv[++i];
             } else if (arg == "--generate-gif") {
                 options.generateGif = true;
+            } else if (arg == "--palette") {
+                options.quantizePalette = true;
+            } else if (arg == "--verbose") {
+                options.verbose = true;
             }
         }
 
@@ -133,6 +196,28 @@ namespace Utils {
         return oss.str();
     }
 
+    // Text utilities
+    std::string escapeJson(const std::string& value) {
+        std::string escaped;
+        for (char c : value) {
+            switch (c) {
+                case '"': escaped += "\\\""; break;
+                case '\\': escaped += "\\\\"; break;
+                case '\n': escaped += "\\n"; break;
+                case '\t': escaped += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char buffer[8];
+                        std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                        escaped += buffer;
+                    } else {
+                        escaped += c;
+                    }
+            }
+        }
+        return escaped;
+    }
+
     // Math utilities
     int clamp(int value, int min, int max) {
         if (value < min) return min;
@@ -0,0 +1,497 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <fstream>
+#include <map>
+#include <set>
+
+#ifndef _WIN32
+#include <dirent.h>
+#endif
+
+#include "QuadTree.hpp"
+#include "ErrorMeasurement.hpp"
+#include "ImageProcessor.hpp"
+#include "GifGenerator.hpp"
+#include "Utils.hpp"
+#include "SyntheticImage.hpp"
+
+#ifndef QUADTREE_TEST_INPUT_DIR
+#define QUADTREE_TEST_INPUT_DIR "test/input"
+#endif
+
+namespace {
+    const char* const ERROR_METHODS[] = {"VAR", "MAD", "MPD", "ENT", "SSIM"};
+    const int BLOCK_SIZES[] = {4, 8, 16, 32, 64, 128};
+
+    struct BenchOptions {
+        int repeat = 5;
+        int kernelImageSize = 512;
+        bool runKernels = true;
+        bool runEndToEnd = true;
+        std::string imageDir = QUADTREE_TEST_INPUT_DIR;
+        std::vector<std::string> images;
+        std::string method = "VAR";
+        double threshold = 10.0;
+        int minBlockSize = 4;
+
+        std::set<std::string> only;  // When not empty, only these results are measured
+
+        std::string jsonFile;      // Write the results here
+        std::string baselineFile;  // Compare the results against this earlier --json output
+        double tolerance = 15.0;   // Allowed slowdown of the fastest run in percent
+    };
+
+    // Summary of repeated timings, in nanoseconds per pixel
+    struct Summary {
+        double median;
+        double min;
+        double mean;
+        double stddev;
+    };
+
+    // One measurement, named "kernel/<content>/<method>/<block>" or "e2e/<image>/<stage>"
+    struct Result {
+        std::string name;
+        Summary summary;
+    };
+
+    // Volatile sink so the optimizer cannot drop kernel results
+    volatile double benchSink = 0;
+
+    // Short bodies are repeated within one sample until it lasts at least this long,
+    // so timer resolution and scheduler noise do not dominate the small kernels
+    const double MIN_SAMPLE_NS = 20e6;
+
+    // A baseline entry's tolerance is at least this many of its standard deviations,
+    // relative to its fastest run
+    const double NOISE_DEVIATIONS = 3.0;
+
+    // Extra measurements of suspected regressions; one is only reported if every pass confirms it
+    const int CONFIRM_PASSES = 2;
+
+    bool wanted(const BenchOptions& options, const std::string& name) {
+        return options.only.empty() || options.only.count(name) > 0;
+    }
+
+    template <typename Body>
+    Summary measure(int repeat, long long pixels, Body body) {
+        // Warm-up run, not timed except to size the samples
+        auto warmStart = std::chrono::steady_clock::now();
+        body();
+        double warmNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - warmStart).count();
+        int iterations = warmNs > 0 ? std::max(1, static_cast<int>(std::ceil(MIN_SAMPLE_NS / warmNs))) : 1;
+
+        std::vector<double> samples;
+        for (int i = 0; i < repeat; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            for (int j = 0; j < iterations; ++j) body();
+            auto end = std::chrono::steady_clock::now();
+            samples.push_back(std::chrono::duration<double, std::nano>(end - start).count() / iterations / pixels);
+        }
+
+        std::sort(samples.begin(), samples.end());
+        Summary summary;
+        summary.min = samples.front();
+        summary.median = samples.size() % 2 ? samples[samples.size() / 2]
+                                            : (samples[samples.size() / 2 - 1] + samples[samples.size() / 2]) / 2;
+        double sum = 0;
+        for (double sample : samples) sum += sample;
+        summary.mean = sum / samples.size();
+        double squares = 0;
+        for (double sample : samples) squares += (sample - summary.mean) * (sample - summary.mean);
+        summary.stddev = samples.size() > 1 ? std::sqrt(squares / (samples.size() - 1)) : 0.0;
+        return summary;
+    }
+
+    void printHeader(const std::string& first, const std::string& second, const std::string& third) {
+        std::cout << std::left << std::setw(24) << first << std::setw(10) << second << std::setw(8) << third
+                  << std::right << std::setw(12) << "median" << std::setw(12) << "min"
+                  << std::setw(12) << "stddev" << "   (ns/pixel)\n";
+    }
+
+    void printRow(const std::string& first, const std::string& second, const std::string& third, const Summary& summary) {
+        std::cout << std::left << std::setw(24) << first << std::setw(10) << second << std::setw(8) << third
+                  << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(12) << summary.median << std::setw(12) << summary.min
+                  << std::setw(12) << summary.stddev << "\n";
+    }
+
+    // Times the average and error kernels over every block that tiles the image
+    void benchKernels(const BenchOptions& options, std::vector<Result>& results) {
+        int size = options.kernelImageSize;
+        std::cout << "== Error kernels (" << size << "x" << size << ", " << options.repeat << " runs) ==\n";
+        printHeader("content", "method", "block");
+
+        for (SyntheticImage::Content content : SyntheticImage::allContents()) {
+            std::vector<std::vector<RGB>> image = SyntheticImage::generate(content, size, size);
+            for (const char* method : ERROR_METHODS) {
+                for (int block : BLOCK_SIZES) {
+                    if (block > size) continue;
+                    std::string name = "kernel/" + SyntheticImage::contentName(content) + "/" + method + "/" +
+                                       std::to_string(block);
+                    if (!wanted(options, name)) continue;
+                    int tiled = size / block * block;
+                    Summary summary = measure(options.repeat, static_cast<long long>(tiled) * tiled, [&]() {
+                        double total = 0;
+                        for (int y = 0; y + block <= size; y += block) {
+                            for (int x = 0; x + block <= size; x += block) {
+                                RGB average = ErrorMeasurement::calculateAverageColor(image, x, y, block, block);
+                                total += ErrorMeasurement::calculateError(image, x, y, block, block, average, method);
+                            }
+                        }
+                        benchSink = benchSink + total;
+                    });
+                    printRow(SyntheticImage::contentName(content), method, std::to_string(block), summary);
+                    results.push_back({name, summary});
+                }
+            }
+        }
+        std::cout << "\n";
+    }
+
+    std::vector<std::string> listImages(const std::string& directory) {
+        std::vector<std::string> files;
+#ifndef _WIN32
+        DIR* dir = opendir(directory.c_str());
+        if (!dir) return files;
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            std::string ext = Utils::getFileExtension(name);
+            std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+            if (ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "bmp" || ext == "ppm") {
+                files.push_back(directory + "/" + name);
+            }
+        }
+        closedir(dir);
+        std::sort(files.begin(), files.end());
+#else
+        (void)directory;  // Pass images explicitly with --image on Windows
+#endif
+        return files;
+    }
+
+    // Times tree building, rendering and GIF generation on real images
+    void benchEndToEnd(const BenchOptions& options, std::vector<Result>& results) {
+        std::vector<std::string> images = options.images.empty() ? listImages(options.imageDir) : options.images;
+        if (images.empty()) {
+            std::cerr << "No benchmark images found in " << options.imageDir << "\n";
+            return;
+        }
+
+        Utils::ProgramOptions::errorMethod = options.method;
+        Utils::ProgramOptions::threshold = options.threshold;
+        Utils::ProgramOptions::minBlockSize = options.minBlockSize;
+
+        std::cout << "== End to end (" << options.method << ", threshold " << options.threshold
+                  << ", min block " << options.minBlockSize << ", " << options.repeat << " runs) ==\n";
+        printHeader("image", "stage", "");
+
+        const std::string gifPath = "quadtree_bench.gif";
+        for (const std::string& path : images) {
+            std::string name = Utils::getFileNameFromPath(path);
+            std::string prefix = "e2e/" + name + "/";
+            if (!wanted(options, prefix + "build") && !wanted(options, prefix + "render") &&
+                !wanted(options, prefix + "gif")) {
+                continue;
+            }
+
+            std::vector<std::vector<RGB>> image;
+            {
+                // loadImage reports every file it reads; keep the table readable
+                std::stringstream discard;
+                std::streambuf* previous = std::cout.rdbuf(discard.rdbuf());
+                try {
+                    image = ImageProcessor::loadImage(path);
+                } catch (const std::exception&) {
+                }
+                std::cout.rdbuf(previous);
+            }
+            if (image.empty() || image[0].empty()) continue;
+
+            int width = image[0].size(), height = image.size();
+            long long pixels = static_cast<long long>(width) * height;
+
+            if (wanted(options, prefix + "build")) {
+                Summary build = measure(options.repeat, pixels, [&]() {
+                    QuadTree tree(width, height);
+                    tree.buildFromImage(image, options.threshold);
+                    benchSink = benchSink + tree.getNodesEvaluated();
+                });
+                printRow(name, "build", "", build);
+                results.push_back({prefix + "build", build});
+            }
+
+            QuadTree tree(width, height);
+            tree.buildFromImage(image, options.threshold);
+
+            if (wanted(options, prefix + "render")) {
+                std::vector<std::vector<RGB>> output;
+                Summary render = measure(options.repeat, pixels, [&]() {
+                    tree.saveToImage(output);
+                });
+                printRow(name, "render", "", render);
+                results.push_back({prefix + "render", render});
+            }
+
+            if (wanted(options, prefix + "gif")) {
+                Summary gif = measure(options.repeat, pixels, [&]() {
+                    GifGenerator::generateCompressionGif(image, tree, gifPath);
+                });
+                printRow(name, "gif", "", gif);
+                results.push_back({prefix + "gif", gif});
+            }
+        }
+        std::remove(gifPath.c_str());
+    }
+
+    // One result per line, so readBaseline can parse the file without a JSON library
+    bool writeJson(const std::string& filename, const BenchOptions& options, const std::vector<Result>& results) {
+        std::ofstream file(filename);
+        if (!file.is_open()) {
+            std::cerr << "Error: Cannot write " << filename << "\n";
+            return false;
+        }
+
+        file << "{\n";
+        file << "  \"unit\": \"ns/pixel\",\n";
+        file << "  \"repeat\": " << options.repeat << ",\n";
+        file << "  \"kernel_size\": " << options.kernelImageSize << ",\n";
+        file << "  \"error_method\": \"" << options.method << "\",\n";
+        file << "  \"threshold\": " << options.threshold << ",\n";
+        file << "  \"min_block\": " << options.minBlockSize << ",\n";
+        file << "  \"results\": [\n";
+        file << std::fixed << std::setprecision(4);
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Summary& summary = results[i].summary;
+            file << "    {\"name\": \"" << results[i].name << "\", \"median\": " << summary.median
+                 << ", \"min\": " << summary.min << ", \"stddev\": " << summary.stddev << "}"
+                 << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        file << "  ]\n";
+        file << "}\n";
+        return static_cast<bool>(file);
+    }
+
+    double readNumber(const std::string& line, const std::string& key) {
+        size_t pos = line.find(key);
+        return pos == std::string::npos ? 0.0 : std::atof(line.c_str() + pos + key.size());
+    }
+
+    std::string readString(const std::string& line, const std::string& key) {
+        size_t pos = line.find(key);
+        if (pos == std::string::npos) return "";
+        pos += key.size();
+        size_t end = line.find('"', pos);
+        return end == std::string::npos ? "" : line.substr(pos, end - pos);
+    }
+
+    // Reads the summaries from a file written by writeJson, and the settings they were measured
+    // with into recorded
+    bool readBaseline(const std::string& filename, std::map<std::string, Summary>& summaries,
+                      BenchOptions& recorded) {
+        std::ifstream file(filename);
+        if (!file.is_open()) {
+            std::cerr << "Error: Cannot read baseline " << filename << "\n";
+            return false;
+        }
+
+        const std::string nameKey = "\"name\": \"";
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.find("\"repeat\": ") != std::string::npos) {
+                recorded.repeat = std::max(1, static_cast<int>(readNumber(line, "\"repeat\": ")));
+            } else if (line.find("\"kernel_size\": ") != std::string::npos) {
+                recorded.kernelImageSize = std::max(4, static_cast<int>(readNumber(line, "\"kernel_size\": ")));
+            } else if (line.find("\"error_method\": \"") != std::string::npos) {
+                recorded.method = readString(line, "\"error_method\": \"");
+            } else if (line.find("\"threshold\": ") != std::string::npos) {
+                recorded.threshold = readNumber(line, "\"threshold\": ");
+            } else if (line.find("\"min_block\": ") != std::string::npos) {
+                recorded.minBlockSize = static_cast<int>(readNumber(line, "\"min_block\": "));
+            }
+
+            size_t namePos = line.find(nameKey);
+            if (namePos == std::string::npos || line.find("\"min\": ") == std::string::npos) continue;
+
+            namePos += nameKey.size();
+            size_t nameEnd = line.find('"', namePos);
+            if (nameEnd == std::string::npos) continue;
+            Summary summary;
+            summary.median = readNumber(line, "\"median\": ");
+            summary.min = readNumber(line, "\"min\": ");
+            summary.mean = summary.median;
+            summary.stddev = readNumber(line, "\"stddev\": ");
+            summaries[line.substr(namePos, nameEnd - namePos)] = summary;
+        }
+        return true;
+    }
+
+    // Change of the fastest run against the baseline's in percent, and the change allowed for it.
+    // Noise only ever adds time, so the fastest runs are far steadier than the medians; entries
+    // that were noisy when the baseline was recorded get a wider tolerance.
+    double changeFromBaseline(const Summary& base, const Summary& current, double tolerance, double& allowed) {
+        allowed = tolerance;
+        if (base.min <= 0) return 0.0;
+        allowed = std::max(tolerance, NOISE_DEVIATIONS * base.stddev / base.min * 100.0);
+        return (current.min / base.min - 1.0) * 100.0;
+    }
+
+    std::set<std::string> findRegressions(const std::map<std::string, Summary>& baseline,
+                                          const std::vector<Result>& results, double tolerance) {
+        std::set<std::string> names;
+        for (const Result& result : results) {
+            auto entry = baseline.find(result.name);
+            double allowed;
+            if (entry != baseline.end() && changeFromBaseline(entry->second, result.summary, tolerance, allowed) > allowed) {
+                names.insert(result.name);
+            }
+        }
+        return names;
+    }
+
+    // Reports every result whose fastest run is slower than the baseline's by more than the
+    // tolerance. Returns the number of regressions.
+    int compareWithBaseline(const std::map<std::string, Summary>& baseline, const std::vector<Result>& results,
+                            double tolerance) {
+        std::cout << "\n== Comparison with baseline (tolerance " << std::defaultfloat << tolerance << "%) ==\n";
+        int regressions = 0, improvements = 0, missing = 0;
+        for (const Result& result : results) {
+            auto entry = baseline.find(result.name);
+            if (entry == baseline.end()) {
+                ++missing;
+                continue;
+            }
+
+            const Summary& base = entry->second;
+            double allowed;
+            double change = changeFromBaseline(base, result.summary, tolerance, allowed);
+            if (change > allowed) {
+                ++regressions;
+                std::cout << "REGRESSION  ";
+            } else if (change < -allowed) {
+                ++improvements;
+                std::cout << "improved    ";
+            } else {
+                continue;
+            }
+            std::cout << std::left << std::setw(40) << result.name << std::right << std::fixed << std::setprecision(3)
+                      << std::setw(12) << base.min << " -> " << std::setw(10) << result.summary.min
+                      << std::showpos << std::setprecision(1) << std::setw(10) << change << "%" << std::noshowpos << "\n";
+        }
+
+        std::cout << results.size() - missing << " compared, " << regressions << " regressed, "
+                  << improvements << " improved";
+        if (missing) std::cout << ", " << missing << " not in the baseline";
+        std::cout << "\n";
+        return regressions;
+    }
+
+    void showUsage(const char* programName) {
+        std::cout << "Usage: " << programName << " [options]\n\n";
+        std::cout << "  --repeat <n>          : Timed runs per measurement (default 5)\n";
+        std::cout << "  --kernel-size <n>     : Side of the synthetic kernel images (default 512)\n";
+        std::cout << "  --kernels-only        : Skip the end-to-end benchmark\n";
+        std::cout << "  --end-to-end-only     : Skip the error kernel benchmark\n";
+        std::cout << "  --image-dir <dir>     : Images for the end-to-end benchmark (default test/input)\n";
+        std::cout << "  --image <file>        : Benchmark this image instead (repeatable)\n";
+        std::cout << "  --error-method <m>    : Error method for end-to-end runs (default VAR)\n";
+        std::cout << "  --threshold <value>   : Threshold for end-to-end runs (default 10)\n";
+        std::cout << "  --min-block <size>    : Minimum block size for end-to-end runs (default 4)\n";
+        std::cout << "  --json <file>         : Write the results as JSON\n";
+        std::cout << "  --compare <file>      : Compare with an earlier --json file; exits with 2 on a regression.\n";
+        std::cout << "                          Uses the file's repeat count and settings unless given here\n";
+        std::cout << "  --tolerance <percent> : Allowed slowdown of the fastest run for --compare (default 15;\n";
+        std::cout << "                          wider for entries with a large spread in the baseline)\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    std::set<std::string> given;  // Settings from the command line win over the baseline's
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        given.insert(arg);
+        if (arg == "--repeat" && i + 1 < argc) {
+            options.repeat = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--kernel-size" && i + 1 < argc) {
+            options.kernelImageSize = std::max(4, std::stoi(argv[++i]));
+        } else if (arg == "--kernels-only") {
+            options.runEndToEnd = false;
+        } else if (arg == "--end-to-end-only") {
+            options.runKernels = false;
+        } else if (arg == "--image-dir" && i + 1 < argc) {
+            options.imageDir = argv[++i];
+        } else if (arg == "--image" && i + 1 < argc) {
+            options.images.push_back(argv[++i]);
+        } else if (arg == "--error-method" && i + 1 < argc) {
+            options.method = argv[++i];
+        } else if (arg == "--threshold" && i + 1 < argc) {
+            options.threshold = std::stod(argv[++i]);
+        } else if (arg == "--min-block" && i + 1 < argc) {
+            options.minBlockSize = std::stoi(argv[++i]);
+        } else if (arg == "--json" && i + 1 < argc) {
+            options.jsonFile = argv[++i];
+        } else if (arg == "--compare" && i + 1 < argc) {
+            options.baselineFile = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            options.tolerance = std::max(0.0, std::stod(argv[++i]));
+        } else {
+            showUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    // Read the baseline first so a bad path fails before the long run. The fastest of more runs
+    // is faster, so the comparison measures with the baseline's repeat count and settings.
+    std::map<std::string, Summary> baseline;
+    if (!options.baselineFile.empty()) {
+        BenchOptions recorded = options;
+        if (!readBaseline(options.baselineFile, baseline, recorded)) return 1;
+        if (!given.count("--repeat")) options.repeat = recorded.repeat;
+        if (!given.count("--kernel-size")) options.kernelImageSize = recorded.kernelImageSize;
+        if (!given.count("--error-method")) options.method = recorded.method;
+        if (!given.count("--threshold")) options.threshold = recorded.threshold;
+        if (!given.count("--min-block")) options.minBlockSize = recorded.minBlockSize;
+        if (options.repeat != recorded.repeat) {
+            std::cerr << "Warning: measuring " << options.repeat << " runs against a baseline of "
+                      << recorded.repeat << "; the fastest runs are not comparable\n";
+        }
+    }
+
+    std::vector<Result> results;
+    if (options.runKernels) benchKernels(options, results);
+    if (options.runEndToEnd) benchEndToEnd(options, results);
+
+    if (!options.jsonFile.empty() && !writeJson(options.jsonFile, options, results)) return 1;
+    if (options.baselineFile.empty()) return 0;
+
+    // A single slow pass is often another process; re-measure the suspects and keep the
+    // faster of the passes, so only regressions seen in every pass are reported
+    std::set<std::string> suspects = findRegressions(baseline, results, options.tolerance);
+    for (int pass = 1; pass <= CONFIRM_PASSES && !suspects.empty(); ++pass) {
+        std::cout << "\n== Re-measuring " << suspects.size() << " suspected regression(s), pass " << pass
+                  << " of " << CONFIRM_PASSES << " ==\n";
+        BenchOptions rerun = options;
+        rerun.only = suspects;
+        std::vector<Result> again;
+        if (rerun.runKernels) benchKernels(rerun, again);
+        if (rerun.runEndToEnd) benchEndToEnd(rerun, again);
+        for (const Result& remeasured : again) {
+            for (Result& result : results) {
+                if (result.name == remeasured.name && remeasured.summary.min < result.summary.min) {
+                    result.summary = remeasured.summary;
+                }
+            }
+        }
+        suspects = findRegressions(baseline, results, options.tolerance);
+    }
+    return compareWithBaseline(baseline, results, options.tolerance) > 0 ? 2 : 0;
+}
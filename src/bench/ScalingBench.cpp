@@ -0,0 +1,210 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "QuadTree.hpp"
+#include "ImageProcessor.hpp"
+#include "Stats.hpp"
+#include "Utils.hpp"
+#include "SyntheticImage.hpp"
+
+namespace {
+    struct MethodThreshold {
+        const char* method;
+        double threshold;
+    };
+
+    // Thresholds that give a mid-sized tree on the procedural content
+    const MethodThreshold DEFAULT_THRESHOLDS[] = {
+        {"VAR", 50.0}, {"MAD", 8.0}, {"MPD", 32.0}, {"ENT", 3.0}, {"SSIM", 0.1}
+    };
+
+    struct ScalingOptions {
+        std::vector<double> megapixels = {1, 4, 16};
+        std::vector<int> threads;
+        std::vector<SyntheticImage::Content> contents = {
+            SyntheticImage::Content::Perlin, SyntheticImage::Content::Mosaic, SyntheticImage::Content::Photo
+        };
+        std::vector<std::string> methods = {"VAR", "MAD", "MPD", "ENT", "SSIM"};
+        int minBlockSize = 4;
+        std::string csvFile;
+
+        // Single-image generation mode
+        std::string generateFile;
+        SyntheticImage::Content generateContent = SyntheticImage::Content::Photo;
+        double generateMegapixels = 1;
+    };
+
+    std::vector<std::string> splitList(const std::string& list) {
+        std::vector<std::string> items;
+        std::stringstream stream(list);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            if (!item.empty()) items.push_back(item);
+        }
+        return items;
+    }
+
+    double thresholdFor(const std::string& method) {
+        for (const MethodThreshold& entry : DEFAULT_THRESHOLDS) {
+            if (method == entry.method) return entry.threshold;
+        }
+        return 10.0;
+    }
+
+    // Square image with roughly the requested number of megapixels
+    int sideForMegapixels(double megapixels) {
+        return std::max(1, static_cast<int>(std::lround(std::sqrt(megapixels * 1e6))));
+    }
+
+    double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void runScaling(const ScalingOptions& options, std::ostream& csv) {
+        csv << "content,megapixels,width,height,method,threshold,threads,"
+               "generate_ms,build_ms,render_ms,nodes,leaves,tree_bytes,peak_rss_kb\n";
+
+        std::vector<double> sizes = options.megapixels;
+        std::sort(sizes.begin(), sizes.end());
+
+        for (SyntheticImage::Content content : options.contents) {
+            for (double megapixels : sizes) {
+                int side = sideForMegapixels(megapixels);
+                std::cerr << "Generating " << SyntheticImage::contentName(content) << " " << side << "x" << side << "...\n";
+
+                auto generateStart = std::chrono::steady_clock::now();
+                std::vector<std::vector<RGB>> image = SyntheticImage::generate(content, side, side);
+                double generateMs = elapsedMs(generateStart);
+
+                for (const std::string& method : options.methods) {
+                    double threshold = thresholdFor(method);
+                    Utils::ProgramOptions::errorMethod = method;
+                    Utils::ProgramOptions::threshold = threshold;
+                    Utils::ProgramOptions::minBlockSize = options.minBlockSize;
+
+                    // The build itself is serial; the thread count applies to rendering
+                    QuadTree tree(side, side);
+                    auto buildStart = std::chrono::steady_clock::now();
+                    tree.buildFromImage(image, threshold);
+                    double buildMs = elapsedMs(buildStart);
+
+                    long long nodes = tree.getNodeCount();
+                    long long leaves = tree.getLeafCount();
+                    long long treeBytes = nodes * static_cast<long long>(sizeof(QuadTreeNode));
+
+                    // The first render allocates the output rows and is not timed
+                    std::vector<std::vector<RGB>> output;
+                    tree.saveToImage(output);
+                    for (int threads : options.threads) {
+                        Utils::ProgramOptions::threads = threads;
+                        auto renderStart = std::chrono::steady_clock::now();
+                        tree.saveToImage(output);
+                        double renderMs = elapsedMs(renderStart);
+
+                        csv << SyntheticImage::contentName(content) << "," << megapixels << "," << side << "," << side
+                            << "," << method << "," << threshold << "," << threads << ","
+                            << std::fixed << std::setprecision(3) << generateMs << "," << buildMs << "," << renderMs
+                            << std::defaultfloat << "," << nodes << "," << leaves << "," << treeBytes
+                            << "," << Stats::peakResidentKB() << "\n";
+                        csv.flush();
+                    }
+                }
+            }
+        }
+    }
+
+    void showUsage(const char* programName) {
+        std::cout << "Usage: " << programName << " [options]\n\n";
+        std::cout << "Scaling mode (CSV on stdout, or --csv):\n";
+        std::cout << "  --sizes <list>        : Image sizes in megapixels (default 1,4,16; up to 1000 = 1 GP)\n";
+        std::cout << "  --threads <list>      : Render thread counts (default 1 and all cores)\n";
+        std::cout << "  --contents <list>     : flat, gradient, noise, text, perlin, mosaic, photo (default perlin,mosaic,photo)\n";
+        std::cout << "  --methods <list>      : Error methods (default VAR,MAD,MPD,ENT,SSIM)\n";
+        std::cout << "  --min-block <size>    : Minimum block size (default 4)\n";
+        std::cout << "  --csv <file>          : Write the results to a file\n\n";
+        std::cout << "Generation mode:\n";
+        std::cout << "  --generate <file>     : Write one procedural image and exit\n";
+        std::cout << "  --content <name>      : Content for --generate (default photo)\n";
+        std::cout << "  --megapixels <n>      : Size for --generate (default 1)\n\n";
+        std::cout << "Sizes run in ascending order, so peak_rss_kb is the process peak up to and including\n";
+        std::cout << "that run; tree_bytes is the exact node storage of the run.\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    ScalingOptions options;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--sizes" && i + 1 < argc) {
+                options.megapixels.clear();
+                for (const std::string& item : splitList(argv[++i])) options.megapixels.push_back(std::stod(item));
+            } else if (arg == "--threads" && i + 1 < argc) {
+                for (const std::string& item : splitList(argv[++i])) options.threads.push_back(std::max(1, std::stoi(item)));
+            } else if ((arg == "--contents" || arg == "--content") && i + 1 < argc) {
+                std::vector<SyntheticImage::Content> contents;
+                for (const std::string& item : splitList(argv[++i])) {
+                    SyntheticImage::Content content;
+                    if (!SyntheticImage::parseContent(item, content)) {
+                        std::cerr << "Unknown content: " << item << "\n";
+                        return 1;
+                    }
+                    contents.push_back(content);
+                }
+                if (arg == "--content" && !contents.empty()) {
+                    options.generateContent = contents[0];
+                } else {
+                    options.contents = contents;
+                }
+            } else if (arg == "--methods" && i + 1 < argc) {
+                options.methods = splitList(argv[++i]);
+            } else if (arg == "--min-block" && i + 1 < argc) {
+                options.minBlockSize = std::stoi(argv[++i]);
+            } else if (arg == "--csv" && i + 1 < argc) {
+                options.csvFile = argv[++i];
+            } else if (arg == "--generate" && i + 1 < argc) {
+                options.generateFile = argv[++i];
+            } else if (arg == "--megapixels" && i + 1 < argc) {
+                options.generateMegapixels = std::stod(argv[++i]);
+            } else {
+                showUsage(argv[0]);
+                return arg == "--help" ? 0 : 1;
+            }
+        }
+
+        if (!options.generateFile.empty()) {
+            int side = sideForMegapixels(options.generateMegapixels);
+            std::vector<std::vector<RGB>> image = SyntheticImage::generate(options.generateContent, side, side);
+            return ImageProcessor::saveImage(image, options.generateFile) ? 0 : 1;
+        }
+
+        if (options.threads.empty()) {
+            options.threads.push_back(1);
+            int cores = static_cast<int>(std::thread::hardware_concurrency());
+            if (cores > 1) options.threads.push_back(cores);
+        }
+
+        if (options.csvFile.empty()) {
+            runScaling(options, std::cout);
+        } else {
+            std::ofstream csv(options.csvFile);
+            if (!csv.is_open()) {
+                std::cerr << "Error: Cannot write " << options.csvFile << "\n";
+                return 1;
+            }
+            runScaling(options, csv);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
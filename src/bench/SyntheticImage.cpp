@@ -0,0 +1,270 @@
+#include "SyntheticImage.hpp"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace {
+    // xorshift32, so the images are identical on every platform
+    uint32_t nextRandom(uint32_t& state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    // Stateless per-pixel hash for content that is generated in parallel
+    uint32_t hashPixel(uint32_t x, uint32_t y, uint32_t seed) {
+        uint32_t h = seed * 0x9E3779B9u ^ x * 0x85EBCA6Bu ^ y * 0xC2B2AE35u;
+        h ^= h >> 16;
+        h *= 0x7FEB352Du;
+        h ^= h >> 15;
+        h *= 0x846CA68Bu;
+        h ^= h >> 16;
+        return h;
+    }
+
+    // Classic 2D gradient noise with a seeded permutation table
+    class PerlinNoise {
+    public:
+        explicit PerlinNoise(uint32_t seed) {
+            for (int i = 0; i < 256; ++i) permutation[i] = i;
+            for (int i = 255; i > 0; --i) {
+                std::swap(permutation[i], permutation[nextRandom(seed) % (i + 1)]);
+            }
+            for (int i = 0; i < 256; ++i) permutation[256 + i] = permutation[i];
+        }
+
+        // Returns a value in roughly [-1, 1]
+        double noise(double x, double y) const {
+            int xi = static_cast<int>(std::floor(x)) & 255;
+            int yi = static_cast<int>(std::floor(y)) & 255;
+            double xf = x - std::floor(x), yf = y - std::floor(y);
+            double u = fade(xf), v = fade(yf);
+
+            int aa = permutation[permutation[xi] + yi], ab = permutation[permutation[xi] + yi + 1];
+            int ba = permutation[permutation[xi + 1] + yi], bb = permutation[permutation[xi + 1] + yi + 1];
+
+            double x1 = lerp(gradient(aa, xf, yf), gradient(ba, xf - 1, yf), u);
+            double x2 = lerp(gradient(ab, xf, yf - 1), gradient(bb, xf - 1, yf - 1), u);
+            return lerp(x1, x2, v);
+        }
+
+        // Sum of octaves; each octave doubles the frequency and scales the amplitude by persistence
+        double fractal(double x, double y, int octaves, double persistence) const {
+            double total = 0, amplitude = 1, norm = 0;
+            for (int i = 0; i < octaves; ++i) {
+                total += noise(x, y) * amplitude;
+                norm += amplitude;
+                amplitude *= persistence;
+                x *= 2;
+                y *= 2;
+            }
+            return total / norm;
+        }
+
+    private:
+        int permutation[512];
+
+        static double fade(double t) { return t * t * t * (t * (t * 6 - 15) + 10); }
+        static double lerp(double a, double b, double t) { return a + t * (b - a); }
+        static double gradient(int hash, double x, double y) {
+            switch (hash & 7) {
+                case 0: return x + y;
+                case 1: return -x + y;
+                case 2: return x - y;
+                case 3: return -x - y;
+                case 4: return x;
+                case 5: return -x;
+                case 6: return y;
+                default: return -y;
+            }
+        }
+    };
+
+    uint8_t toChannel(double value) {
+        return static_cast<uint8_t>(std::max(0.0, std::min(255.0, value * 255.0 + 0.5)));
+    }
+
+    void drawPerlin(std::vector<std::vector<RGB>>& image, int width, int firstRow, int lastRow, const PerlinNoise& noise) {
+        const double scale = 1.0 / 128.0;
+        for (int y = firstRow; y < lastRow; ++y) {
+            for (int x = 0; x < width; ++x) {
+                double fx = x * scale, fy = y * scale;
+                image[y][x] = {toChannel(0.5 + 0.5 * noise.fractal(fx, fy, 4, 0.5)),
+                               toChannel(0.5 + 0.5 * noise.fractal(fx + 37.1, fy + 11.7, 4, 0.5)),
+                               toChannel(0.5 + 0.5 * noise.fractal(fx + 71.3, fy + 53.9, 4, 0.5))};
+            }
+        }
+    }
+
+    void drawPhoto(std::vector<std::vector<RGB>>& image, int width, int firstRow, int lastRow,
+                   const PerlinNoise& noise, uint32_t seed) {
+        // Amplitude halving per octave gives the roughly 1/f^2 power spectrum of natural scenes
+        const double scale = 1.0 / 512.0;
+        for (int y = firstRow; y < lastRow; ++y) {
+            for (int x = 0; x < width; ++x) {
+                double fx = x * scale, fy = y * scale;
+                double luminance = 0.5 + 1.2 * noise.fractal(fx, fy, 9, 0.5);
+                double tint = 0.15 * noise.fractal(fx * 0.5 + 19.3, fy * 0.5 + 7.1, 3, 0.5);
+                double grain = (static_cast<int>(hashPixel(x, y, seed) & 7) - 3.5) / 255.0;
+                image[y][x] = {toChannel(luminance + tint + grain),
+                               toChannel(luminance * 0.95 + grain),
+                               toChannel(luminance * 0.85 - tint + grain)};
+            }
+        }
+    }
+
+    // Recursively splits rectangles at random positions and fills the pieces with flat colors
+    void drawMosaic(std::vector<std::vector<RGB>>& image, int width, int height, uint32_t state) {
+        struct Tile { int x, y, w, h; };
+        std::vector<Tile> pending(1, Tile{0, 0, width, height});
+        while (!pending.empty()) {
+            Tile tile = pending.back();
+            pending.pop_back();
+
+            uint32_t roll = nextRandom(state);
+            long long area = static_cast<long long>(tile.w) * tile.h;
+            bool split = tile.w >= 32 && tile.h >= 32 && (area > 256 * 256 || roll % 4 != 0);
+            if (split) {
+                if (tile.w >= tile.h) {
+                    int cut = 8 + static_cast<int>(nextRandom(state) % (tile.w - 16));
+                    pending.push_back({tile.x, tile.y, cut, tile.h});
+                    pending.push_back({tile.x + cut, tile.y, tile.w - cut, tile.h});
+                } else {
+                    int cut = 8 + static_cast<int>(nextRandom(state) % (tile.h - 16));
+                    pending.push_back({tile.x, tile.y, tile.w, cut});
+                    pending.push_back({tile.x, tile.y + cut, tile.w, tile.h - cut});
+                }
+                continue;
+            }
+
+            uint32_t color = nextRandom(state);
+            RGB fill = {static_cast<uint8_t>(color), static_cast<uint8_t>(color >> 8), static_cast<uint8_t>(color >> 16)};
+            for (int y = tile.y; y < tile.y + tile.h; ++y) {
+                std::fill_n(image[y].begin() + tile.x, tile.w, fill);
+            }
+        }
+    }
+
+    template <typename RowFunction>
+    void forRowBands(int height, unsigned int threads, RowFunction drawRows) {
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        threads = std::max(1u, std::min(threads, static_cast<unsigned int>(std::max(1, height / 64))));
+
+        std::vector<std::thread> workers;
+        int band = (height + threads - 1) / threads;
+        for (unsigned int t = 1; t < threads; ++t) {
+            int first = std::min(height, static_cast<int>(t) * band);
+            int last = std::min(height, first + band);
+            workers.emplace_back(drawRows, first, last);
+        }
+        drawRows(0, std::min(height, band));
+        for (auto& worker : workers) worker.join();
+    }
+
+    void drawText(std::vector<std::vector<RGB>>& image, int width, int height, uint32_t state) {
+        const RGB ink = {20, 20, 30};
+        const int cellWidth = 8, cellHeight = 12, stroke = 1;
+
+        // Each glyph lights a few segments of a 3x5 stroke grid
+        for (int top = 4; top + cellHeight <= height; top += cellHeight + 4) {
+            for (int left = 4; left + cellWidth <= width; left += cellWidth) {
+                uint32_t glyph = nextRandom(state);
+                if ((glyph & 7) == 0) continue;  // Word gap
+
+                for (int segment = 0; segment < 15; ++segment) {
+                    if (!((glyph >> (segment + 3)) & 1)) continue;
+                    int gx = left + 1 + (segment % 3) * 2;
+                    int gy = top + 1 + (segment / 3) * 2;
+                    for (int y = gy; y < gy + 2 + stroke && y < height; ++y) {
+                        for (int x = gx; x < gx + 1 + stroke && x < width; ++x) {
+                            image[y][x] = ink;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+namespace SyntheticImage {
+    const std::vector<Content>& allContents() {
+        static const std::vector<Content> contents = {
+            Content::Flat, Content::Gradient, Content::Noise, Content::Text,
+            Content::Perlin, Content::Mosaic, Content::Photo
+        };
+        return contents;
+    }
+
+    std::string contentName(Content content) {
+        switch (content) {
+            case Content::Flat: return "flat";
+            case Content::Gradient: return "gradient";
+            case Content::Noise: return "noise";
+            case Content::Text: return "text";
+            case Content::Perlin: return "perlin";
+            case Content::Mosaic: return "mosaic";
+            case Content::Photo: return "photo";
+        }
+        return "unknown";
+    }
+
+    bool parseContent(const std::string& name, Content& content) {
+        for (Content candidate : allContents()) {
+            if (contentName(candidate) == name) {
+                content = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::vector<RGB>> generate(Content content, int width, int height, uint32_t seed, unsigned int threads) {
+        std::vector<std::vector<RGB>> image(height, std::vector<RGB>(width, {240, 236, 228}));
+        uint32_t state = seed ? seed : 1;
+
+        switch (content) {
+            case Content::Flat:
+                break;
+            case Content::Gradient:
+                for (int y = 0; y < height; ++y) {
+                    for (int x = 0; x < width; ++x) {
+                        image[y][x] = {static_cast<uint8_t>(255 * x / std::max(1, width - 1)),
+                                       static_cast<uint8_t>(255 * y / std::max(1, height - 1)),
+                                       static_cast<uint8_t>(255 * (x + y) / std::max(1, width + height - 2))};
+                    }
+                }
+                break;
+            case Content::Noise:
+                for (int y = 0; y < height; ++y) {
+                    for (int x = 0; x < width; ++x) {
+                        uint32_t value = nextRandom(state);
+                        image[y][x] = {static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8),
+                                       static_cast<uint8_t>(value >> 16)};
+                    }
+                }
+                break;
+            case Content::Text:
+                drawText(image, width, height, state);
+                break;
+            case Content::Perlin: {
+                PerlinNoise noise(state);
+                forRowBands(height, threads, [&](int first, int last) {
+                    drawPerlin(image, width, first, last, noise);
+                });
+                break;
+            }
+            case Content::Mosaic:
+                drawMosaic(image, width, height, state);
+                break;
+            case Content::Photo: {
+                PerlinNoise noise(state);
+                forRowBands(height, threads, [&](int first, int last) {
+                    drawPhoto(image, width, first, last, noise, state);
+                });
+                break;
+            }
+        }
+        return image;
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef SYNTHETIC_IMAGE_HPP
+#define SYNTHETIC_IMAGE_HPP
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "QuadTree.hpp"
+
+// Deterministic procedural test images for the benchmarks
+namespace SyntheticImage {
+    enum class Content {
+        Flat,      // One solid color
+        Gradient,  // Smooth diagonal ramp
+        Noise,     // Uniform random pixels
+        Text,      // Dark glyph strokes on a light page
+        Perlin,    // Smooth multi-octave gradient noise
+        Mosaic,    // Piecewise-flat tiles from random recursive splits
+        Photo      // Fractal noise with a natural-image-like 1/f spectrum plus sensor grain
+    };
+
+    const std::vector<Content>& allContents();
+    std::string contentName(Content content);
+    bool parseContent(const std::string& name, Content& content);
+
+    // Perlin and photo rows are generated on worker threads; threads = 0 uses all hardware threads.
+    // Feature sizes are fixed in pixels, so larger images contain proportionally more detail.
+    std::vector<std::vector<RGB>> generate(Content content, int width, int height, uint32_t seed = 1,
+                                           unsigned int threads = 0);
+}
+
+#endif // SYNTHETIC_IMAGE_HPP
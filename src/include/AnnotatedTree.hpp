@@ -0,0 +1,74 @@
+#ifndef ANNOTATED_TREE_HPP
+#define ANNOTATED_TREE_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "QuadTree.hpp"
+
+// The full-depth quadtree of one image, with each block's average color and, per error method,
+// its error. A block's statistics are computed with the same kernels as a normal build the first
+// time any build reaches it and are kept from then on, so building the image again with any
+// method, threshold or minimum block size gives the same tree while reading pixels only for
+// blocks no earlier build evaluated. Block positions follow from the image size, as in QuadTree.
+class AnnotatedTree {
+public:
+    AnnotatedTree(int width, int height, uint64_t imageHash);
+
+    // Same size and pixel hash
+    bool matches(int width, int height, uint64_t imageHash) const;
+    uint64_t getImageHash() const;
+
+    // Builds tree like QuadTree::buildFromImage with the given method, threshold and minimum block
+    // size; onLevelComplete is called as in the breadth-first build
+    void build(QuadTree& tree, const std::vector<std::vector<RGB>>& image, const std::string& errorMethod,
+               double threshold, int minBlockSize, const QuadTree::LevelCallback& onLevelComplete = nullptr);
+
+    // Leaf count of the tree build would give, without creating its nodes
+    long long countLeaves(const std::vector<std::vector<RGB>>& image, const std::string& errorMethod,
+                          double threshold, int minBlockSize);
+
+    // Blocks whose statistics the last build or count reused or computed
+    long long getReusedCount() const;
+    long long getComputedCount() const;
+    // Whether blocks were computed since the tree was created, loaded or saved
+    bool isModified() const;
+
+    // Memory per block with errors for the given number of methods
+    static long long blockBytes(int methods);
+
+    // Persistence, in native byte order; load returns null if the file is missing or does not
+    // hold an annotated tree of this image
+    bool save(const std::string& filename);
+    static std::unique_ptr<AnnotatedTree> load(const std::string& filename, int width, int height, uint64_t imageHash);
+
+private:
+    static const int METHOD_COUNT = 5;  // VAR, MAD, MPD, ENT, SSIM
+
+    struct Block {
+        uint32_t firstChild = 0;  // Index of the first of four children, 0 until the block is split
+        RGB average = {0, 0, 0};
+        bool hasAverage = false;
+    };
+
+    int width;
+    int height;
+    uint64_t imageHash;
+    std::vector<Block> blocks;                  // Root first; children are allocated in groups of four
+    std::vector<double> errors[METHOD_COUNT];   // Per method, indexed like blocks; NaN until computed
+    long long reused;
+    long long computed;
+    bool modified;
+
+    static int methodIndex(const std::string& errorMethod);
+    // Error of a block, computing its average and error on first use; adds the pixels read to scanned
+    double evaluate(uint32_t index, const std::vector<std::vector<RGB>>& image, int x, int y,
+                    int blockWidth, int blockHeight, const std::string& errorMethod,
+                    std::vector<double>& methodErrors, long long& scanned);
+    static bool shouldSplit(double error, double threshold, int blockWidth, int blockHeight, int minBlockSize);
+    // Index of the block's first child, allocating the four children on first use
+    uint32_t allocateChildren(uint32_t index);
+};
+
+#endif // ANNOTATED_TREE_HPP
@@ -0,0 +1,32 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <string>
+#include <vector>
+#include "Utils.hpp"
+
+// Compresses a list of images with the same options on several threads.
+// Every input is probed first (header only), the jobs run largest-first, and a job
+// only starts while the estimated memory of all running jobs fits the budget.
+namespace Batch {
+    struct Job {
+        std::string inputFile;
+        std::string outputFile;
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        long long estimatedBytes = 0;   // Peak while decoding or while the image and tree coexist
+        double estimatedSeconds = 0;    // Single-threaded build time, for ordering and the plan
+    };
+
+    // Upper bound of the memory one image needs: the decoded pixels plus a full tree down to minBlockSize,
+    // and its annotated tree if annotated
+    long long estimateBytes(int width, int height, int channels, int minBlockSize, bool annotated = false);
+    // Rough single-threaded build time from measured per-pixel, per-level costs of each method
+    double estimateSeconds(int width, int height, const std::string& errorMethod, int minBlockSize);
+
+    // Runs --batch <list>; returns the exit code (1 if any image failed)
+    int run(Utils::ProgramOptions& options);
+}
+
+#endif // BATCH_HPP
@@ -0,0 +1,20 @@
+#ifndef COST_MAP_HPP
+#define COST_MAP_HPP
+
+#include <string>
+#include "QuadTree.hpp"
+
+// Heatmaps of a built tree for --cost-map
+namespace CostMap {
+    // Writes two images with the tree's leaves colored from dark (low) to bright (high):
+    //  - filename: pixels scanned per pixel to decide each leaf, 2 * (depth + 1), since every
+    //    ancestor's average and error kernels read the leaf's pixels once each
+    //  - <name>_error.<ext>: the leaf's error relative to the threshold on a log scale from 1/8x to 8x;
+    //    leaves above 1x were stopped by the minimum block size
+    bool save(const QuadTree& tree, double threshold, const std::string& filename);
+
+    // Maps t in [0, 1] onto a black-purple-orange-yellow ramp
+    RGB heatColor(double t);
+}
+
+#endif // COST_MAP_HPP
@@ -0,0 +1,91 @@
+#ifndef DEFLATE_HPP
+#define DEFLATE_HPP
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Incremental zlib (RFC 1950/1951) compressor using fixed Huffman codes.
+// Input can be fed in arbitrary pieces; only the last 32 KB window is kept in memory.
+class DeflateStream {
+public:
+    // level 1 (fastest) to 9 (smallest output) controls the match search depth.
+    // Without the zlib wrapper a raw deflate stream is produced.
+    explicit DeflateStream(int level = 6, bool zlibWrapper = true);
+
+    // Prime the match window with preceding data; must be called before write()
+    void setDictionary(const uint8_t* data, size_t size);
+
+    // Compress more input, appending any finished output bytes to out
+    void write(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+
+    // Compress all pending input and byte-align the output with an empty stored block
+    void flush(std::vector<uint8_t>& out);
+
+    // Compress the remaining input and terminate the stream
+    void finish(std::vector<uint8_t>& out);
+
+    // Checksums used by the zlib and PNG containers
+    static uint32_t adler32(uint32_t adler, const uint8_t* data, size_t size);
+    static uint32_t adler32Combine(uint32_t adler1, uint32_t adler2, size_t length2);
+    static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size);
+
+private:
+    int maxChain;
+    bool lazyMatching;
+    bool zlibWrapper;
+
+    // Sliding input buffer; buffer[0] is at absolute stream offset bufferStart
+    std::vector<uint8_t> buffer;
+    int64_t bufferStart;
+    size_t position;
+
+    // Hash chains over absolute offsets
+    std::vector<int64_t> head;
+    std::vector<int64_t> prev;
+
+    uint64_t bitBuffer;
+    int bitCount;
+    bool headerWritten;
+    bool blockOpen;
+    uint32_t adler;
+    std::vector<uint8_t> output;
+
+    void compress(bool flushAll);
+    void slideWindow();
+    void insertHash(size_t index);
+    int findMatch(size_t index, int& distance) const;
+
+    void putBits(uint32_t value, int count);
+    void alignToByte();
+    void writeHeader();
+    void openBlock();
+    void emitLiteral(uint8_t value);
+    void emitMatch(int length, int distance);
+};
+
+// zlib compressor that deflates fixed-size blocks of input on worker threads (pigz-style).
+// Each block is primed with the previous block's last 32 KB and ends in a sync flush,
+// so the pieces concatenate into one valid stream; the Adler-32 values are combined.
+class ParallelDeflate {
+public:
+    // threads = 0 uses the hardware concurrency
+    explicit ParallelDeflate(int level = 6, unsigned int threads = 0);
+
+    void write(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+    void finish(std::vector<uint8_t>& out);
+
+private:
+    int level;
+    unsigned int threadCount;
+    bool headerWritten;
+    uint32_t adler;
+
+    std::vector<std::vector<uint8_t>> pending;
+    std::vector<uint8_t> current;
+    std::vector<uint8_t> dictionary;
+
+    void compressPending(bool last, std::vector<uint8_t>& out);
+};
+
+#endif // DEFLATE_HPP
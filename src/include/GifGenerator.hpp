@@ -3,10 +3,90 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include "QuadTree.hpp"
+#include "Palette.hpp"
 
 class GifGenerator {
+private:
+    // Persistent RGBA canvas that frames are drawn into and handed to the GIF encoder
+    struct FrameBuffer {
+        int width;
+        int height;
+        std::vector<uint8_t> pixels;
+
+        FrameBuffer(int width, int height, const RGB& background);
+        void fillRect(int x, int y, int w, int h, const RGB& color);
+    };
+
 public:
+    // Writes the compression animation one tree level at a time. Each level's blocks are
+    // copied into a bounded queue and drawn and encoded on a worker thread, so frames are
+    // encoded while deeper levels are still being built. All frames share one palette,
+    // fixed up front from the tree's node colors or the image's pixel colors; without
+    // either, it grows as the levels' colors arrive.
+    class AnimationWriter {
+    public:
+        AnimationWriter();
+        ~AnimationWriter();
+        AnimationWriter(const AnimationWriter&) = delete;
+        AnimationWriter& operator=(const AnimationWriter&) = delete;
+
+        bool begin(const std::string& filename, int width, int height, int frameDelay = 10);
+        // Builds the palette up front from every node color of a finished tree
+        void fixPalette(const QuadTree& tree);
+        // Builds the palette from the image before its tree exists; block averages and
+        // their border shades use the nearest entry
+        void fixPalette(const std::vector<std::vector<RGB>>& image);
+        // Queues the nodes of the next level, to be drawn on top of the previous frame.
+        // Waits only while the queue is full. The palette must be fixed before the first call.
+        bool writeLevel(const std::vector<QuadTreeNode*>& nodes);
+        // Waits for the queued levels, writes the finished image without block borders
+        // and closes the file
+        bool finish(const QuadTree& tree);
+
+    private:
+        // What a frame needs from a node, copied so the build can go on
+        struct Block {
+            int x, y, width, height;
+            RGB color;
+        };
+
+        FILE* file;
+        int frameDelay;
+        FrameBuffer frame;
+        std::vector<uint8_t> shown;  // Canvas as of the last written frame
+        bool firstFrame;
+        std::vector<RGB> paletteEntries;                     // Palette index i + 1
+        std::unordered_map<uint32_t, uint8_t> paletteIndex;  // Packed color to palette index
+        bool paletteFixed;
+
+        // Levels waiting for the worker; only these members are shared with it
+        std::deque<std::vector<Block>> queue;
+        size_t queuedBlocks;
+        bool closing;
+        bool failed;
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::thread worker;
+
+        // Worker loop: draws and encodes queued levels until the queue is closed and empty
+        void encodeLevels();
+        bool encodeLevel(const std::vector<Block>& blocks);
+        // Lets the worker finish the queue and joins it
+        void stopWorker();
+        // Palette index of a color, adding it while a growing palette has room
+        uint8_t paletteIndexOf(const RGB& color);
+        // Encodes one region of the canvas as palette indices
+        bool writeRegion(int left, int top, int width, int height, int delay);
+    };
+
     // Creates a GIF showing progressive compression steps
     static bool generateCompressionGif(
         const std::vector<std::vector<RGB>>& originalImage,
@@ -21,15 +101,19 @@ public:
         bool showBorders = true);
 
 private:
-    // Helper method to recursively draw tree nodes
+    // Helper methods to draw tree nodes
     static void drawNode(
-        std::vector<std::vector<RGB>>& frame,
+        FrameBuffer& frame,
         const QuadTreeNode* node,
         bool showBorders);
-    static void collectNodesByLevel(
-        const QuadTreeNode* node,
-        std::vector<std::vector<QuadTreeNode*>>& nodesByLevel,
-        int level = 0);
+    static void drawBlock(
+        FrameBuffer& frame,
+        int x, int y, int width, int height,
+        const RGB& color,
+        bool showBorders);
+    static void drawLeaves(
+        FrameBuffer& frame,
+        const QuadTreeNode* node);
 };
 
 #endif // GIF_GENERATOR_HPP
\ No newline at end of file
@@ -3,13 +3,26 @@
 
 #include <vector>
 #include <string>
+#include <functional>
 #include "QuadTree.hpp"
 
 class ImageProcessor {
 public:
-    // Image loading and saving
+    // Image loading and saving. "-" reads standard input; binary PPM, PGM and PAM are copied
+    // into the rows without decoding, and everything else goes through stb_image
     static std::vector<std::vector<RGB>> loadImage(const std::string& filename);
+    // Decodes an encoded image (Netpbm or any format stb_image reads) that is already in memory
+    static std::vector<std::vector<RGB>> loadImageFromMemory(const unsigned char* data, size_t size);
+    // Reads only the header for the dimensions and channel count; false if the file is unreadable
+    static bool probeImage(const std::string& filename, int& width, int& height, int& channels);
+    // The encoder is chosen by extension (png, jpg, ppm, pam); "-" writes ProgramOptions::outputFormat
+    // to standard output
     static bool saveImage(const std::vector<std::vector<RGB>>& image, const std::string& filename);
+    // Streams scanlines straight from the tree's leaves into the encoder.
+    // PNG output is indexed when the leaves use at most 256 colors, or always when quantizePalette is set.
+    static bool saveImage(const QuadTree& tree, const std::string& filename, bool quantizePalette = false);
+    // Lowercase encoder name for filename: "png", "jpg", "ppm", "pam", or an unsupported extension
+    static std::string outputFormat(const std::string& filename);
 
     // Image conversion and manipulation
     static std::vector<std::vector<RGB>> extractRegion(
@@ -24,6 +37,21 @@ public:
     // Utility functions for pixel operations
     static RGB getPixel(const std::vector<std::vector<RGB>>& image, int x, int y);
     static void setPixel(std::vector<std::vector<RGB>>& image, int x, int y, const RGB& color);
+
+private:
+    // Expands stb_image's interleaved 1-4 channel pixels into RGB rows
+    static std::vector<std::vector<RGB>> convertPixels(const unsigned char* data, int width, int height, int channels);
+    // P5, P6 or P7 header; pos is left at the first raster byte and depth is the channel count
+    static bool parseNetpbmHeader(const unsigned char* data, size_t size, size_t& pos,
+                                  int& width, int& height, int& depth, int& maxValue);
+    // Reads 8-bit binary P5, P6 and P7 images; false when the data is another format or variant
+    static bool decodeNetpbm(const unsigned char* data, size_t size, std::vector<std::vector<RGB>>& image);
+
+    // Shared save path; rowSource returns the pixels of scanline y
+    static bool writeImage(int width, int height,
+                           const std::function<const RGB*(int)>& rowSource,
+                           const std::string& filename,
+                           const std::vector<RGB>& palette = std::vector<RGB>());
 };
 
 #endif // IMAGE_PROCESSOR_HPP
\ No newline at end of file
@@ -0,0 +1,52 @@
+#ifndef JPEG_WRITER_HPP
+#define JPEG_WRITER_HPP
+
+#include <vector>
+#include <cstdint>
+#include "ScanlineWriter.hpp"
+
+// Streaming baseline JPEG encoder (same tables and DCT as stb_image_write).
+// Every MCU row is an independent restart interval, so buffered MCU rows are
+// entropy-coded concurrently and joined with RSTn markers.
+class JpegWriter : public ScanlineWriter {
+public:
+    // threads = 0 uses the hardware concurrency
+    explicit JpegWriter(int quality = 90, unsigned int threads = 0);
+
+    bool begin(const std::string& filename, int width, int height) override;
+    bool writeRow(const RGB* row) override;
+    bool finish() override;
+
+private:
+    // Entropy-coded data of one restart interval
+    struct Segment {
+        std::vector<uint8_t> bytes;
+        uint32_t bitBuffer;
+        int bitCount;
+    };
+
+    int quality;
+    unsigned int threadCount;
+    int width;
+    int height;
+    int rowsWritten;
+    bool subsample;
+    int mcuSize;
+
+    float fdtblY[64];
+    float fdtblUV[64];
+
+    // Pixel rows of the MCU rows waiting to be encoded; the last one may be partially filled
+    std::vector<std::vector<RGB>> stripes;
+    size_t pendingStripes;
+    int stripeRows;
+    int mcuRowsWritten;
+
+    void writeHeaders(const uint8_t* yTable, const uint8_t* uvTable);
+    void flushStripes();
+    void encodeStripe(const std::vector<RGB>& pixels, Segment& segment) const;
+    int processDU(Segment& segment, float* cdu, int stride, const float* fdtbl, int dc, bool chroma) const;
+    static void writeBits(Segment& segment, uint16_t code, int length);
+};
+
+#endif // JPEG_WRITER_HPP
@@ -0,0 +1,26 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+
+// Cumulative throughput metrics in the Prometheus text format, for the node_exporter
+// textfile collector (point it at a directory and name the file *.prom)
+namespace Metrics {
+    // One compressed image: input and output file sizes and the tree build time
+    void recordImage(const std::string& errorMethod, long long inputBytes, long long outputBytes,
+                     double buildSeconds);
+    // A failed request; stage is a short label such as "decode", "save" or "gif"
+    void recordError(const std::string& stage);
+    // Requests waiting to be processed; only meaningful for long-running modes
+    void setQueueDepth(long long depth);
+
+    // Writes everything recorded by this process, plus the per-phase times from Stats.
+    // The file is written to a temporary name and renamed, so the collector never sees it half-written.
+    bool writeTextfile(const std::string& filename);
+
+    // For one-shot runs: adds this process's counters to the ones already in the file, so a batch
+    // of separate invocations accumulates. Updates are serialized with a lock file on POSIX.
+    bool mergeIntoTextfile(const std::string& filename);
+}
+
+#endif // METRICS_HPP
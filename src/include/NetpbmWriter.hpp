@@ -0,0 +1,23 @@
+#ifndef NETPBM_WRITER_HPP
+#define NETPBM_WRITER_HPP
+
+#include "ScanlineWriter.hpp"
+
+// Uncompressed binary PPM (P6) or PAM (P7, TUPLTYPE RGB) output: a short text
+// header followed by the rows exactly as they are rendered, so there is nothing to encode
+class NetpbmWriter : public ScanlineWriter {
+public:
+    explicit NetpbmWriter(bool pam = false);
+
+    bool begin(const std::string& filename, int width, int height) override;
+    bool writeRow(const RGB* row) override;
+    bool finish() override;
+
+private:
+    bool pam;
+    int width;
+    int height;
+    int rowsWritten;
+};
+
+#endif // NETPBM_WRITER_HPP
@@ -0,0 +1,34 @@
+#ifndef PALETTE_HPP
+#define PALETTE_HPP
+
+#include <vector>
+#include <cstdint>
+#include "QuadTree.hpp"
+
+namespace Palette {
+    // A distinct color and the number of pixels it covers
+    struct Entry {
+        RGB color;
+        long long weight;
+    };
+
+    // Distinct leaf colors of the tree weighted by block area.
+    // Stops early and returns limit + 1 entries once more than limit colors are seen (0 = no limit).
+    std::vector<Entry> collectLeafColors(const QuadTree& tree, size_t limit = 0);
+
+    // Pixel colors of an image grouped into 32 levels per channel, each group's average
+    // weighted by its pixel count
+    std::vector<Entry> collectImageColors(const std::vector<std::vector<RGB>>& image);
+
+    // Reduce weighted colors to at most maxColors entries using median cut
+    std::vector<RGB> medianCut(std::vector<Entry> colors, size_t maxColors);
+
+    // Index of the palette entry closest to color
+    int nearestIndex(const std::vector<RGB>& palette, const RGB& color);
+
+    inline uint32_t packColor(const RGB& color) {
+        return (static_cast<uint32_t>(color.r) << 16) | (static_cast<uint32_t>(color.g) << 8) | color.b;
+    }
+}
+
+#endif // PALETTE_HPP
@@ -0,0 +1,45 @@
+#ifndef PNG_WRITER_HPP
+#define PNG_WRITER_HPP
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include "ScanlineWriter.hpp"
+#include "Deflate.hpp"
+
+// Streaming PNG encoder: 24-bit RGB, or 8-bit indexed when a palette is set
+class PngWriter : public ScanlineWriter {
+public:
+    // compressionLevel 1-9 trades speed for size; image data is deflated on worker threads
+    explicit PngWriter(int compressionLevel = 6, unsigned int threads = 0);
+
+    // Switch to indexed output (at most 256 entries); must be called before begin().
+    // Pixels not in the palette are mapped to the nearest entry.
+    void setPalette(const std::vector<RGB>& palette);
+
+    bool begin(const std::string& filename, int width, int height) override;
+    bool writeRow(const RGB* row) override;
+    bool finish() override;
+
+private:
+    ParallelDeflate deflate;
+    int width;
+    int height;
+    int rowsWritten;
+
+    std::vector<RGB> palette;
+    std::unordered_map<uint32_t, uint8_t> paletteIndex;
+
+    std::vector<uint8_t> previousRow;
+    std::vector<uint8_t> currentRow;
+    std::vector<uint8_t> candidateRow;
+    std::vector<uint8_t> bestRow;
+    std::vector<uint8_t> compressed;
+
+    uint8_t lookupIndex(const RGB& color);
+    void filterRow(int filterType, std::vector<uint8_t>& filtered) const;
+    void writeChunk(const char* type, const uint8_t* data, size_t size);
+    void flushImageData(bool force);
+};
+
+#endif // PNG_WRITER_HPP
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <vector>
 #include <utility>
+#include <functional>
 #include <cstdint>
 
 // RGB color structure
@@ -54,19 +55,52 @@ public:
 };
 
 class QuadTree {
+public:
+    // Receives each level's nodes once all of them have been evaluated, before the next level is built
+    using LevelCallback = std::function<void(int depth, const std::vector<QuadTreeNode*>& nodes)>;
+    // Returns the color a leaf is rendered with; called from several threads at once
+    using LeafColorFunction = std::function<RGB(const QuadTreeNode& leaf, int depth)>;
+
+    // Error histogram bins are in units of the threshold, with upper bounds
+    // 1/8, 1/4, 1/2, 1, 2, 4, 8 and infinity; the first four bins never split
+    static const int ERROR_BINS = 8;
+    static double errorBinUpperBound(int bin);
+
+    // Work done at one depth of the last build, collected while building
+    struct DepthStats {
+        long long nodes = 0;          // Nodes evaluated at this depth
+        long long leaves = 0;
+        long long pixelsScanned = 0;
+        double milliseconds = 0;      // Kernel time for this depth's nodes, only measured with --verbose
+        double errorSum = 0;
+        double errorMax = 0;
+        long long errorHistogram[ERROR_BINS] = {};
+    };
+
 private:
     QuadTreeNode* root;
     int imageWidth;
     int imageHeight;
     double totalError;
+    long long nodesEvaluated;  // Work done by the last build
+    long long pixelsScanned;
+    std::vector<DepthStats> depthStats;
 
 public:
     // Constructor and destructor
     QuadTree(int width, int height);
     ~QuadTree();
 
+    // A tree owns its nodes, so it can be moved but not copied
+    QuadTree(QuadTree&& other) noexcept;
+    QuadTree& operator=(QuadTree&& other) noexcept;
+    QuadTree(const QuadTree&) = delete;
+    QuadTree& operator=(const QuadTree&) = delete;
+
     // Building tree from image
     void buildFromImage(const std::vector<std::vector<RGB>>& image, double threshold);
+    // Breadth-first build that reports every completed level
+    void buildFromImage(const std::vector<std::vector<RGB>>& image, const LevelCallback& onLevelComplete);
 
     // Compression
     void compress(double threshold);
@@ -76,19 +110,56 @@ public:
     QuadTreeNode* getRoot() const;
     int countNodes() const;
     int countLeafNodes() const;
+    long long getNodesEvaluated() const;
+    long long getPixelsScanned() const;  // Block pixels read by the average and error kernels
+
+    // Counters from the last build, without walking the tree
+    const std::vector<DepthStats>& getDepthStats() const;
+    int getDepth() const;
+    long long getNodeCount() const;
+    long long getLeafCount() const;
 
     // Output
     void saveToImage(std::vector<std::vector<RGB>>& outputImage) const;
+    void saveToImage(std::vector<std::vector<RGB>>& outputImage, const LeafColorFunction& leafColor) const;
+    void renderRow(int y, std::vector<RGB>& row) const;  // Render a single scanline from the leaves
+    // Renders the leaves into a caller-supplied buffer of packed RGB rows, stride bytes apart,
+    // with the same subtree split and worker threads as saveToImage
+    void renderInto(uint8_t* pixels, size_t stride) const;
+
+    // Serialization for the result cache: every node in preorder as a leaf flag byte,
+    // the average color and the error. Node positions follow from the tree's size.
+    void write(std::ostream& out) const;
+    // Replaces the nodes with ones written by write() for a tree of the same size. The per-depth
+    // counters are recomputed against threshold, without timings or scanned pixels.
+    // Returns false and leaves a bare root if the data is malformed.
+    bool read(std::istream& in, double threshold);
 
     // Memory management
     void clear();
 
 private:
     // Helper methods for recursive operations
-    void buildNodeRecursive(QuadTreeNode* node, const std::vector<std::vector<RGB>>& image, double threshold);
+    void buildNodeRecursive(QuadTreeNode* node, const std::vector<std::vector<RGB>>& image, double threshold, int depth);
+    void buildLevels(const std::vector<std::vector<RGB>>& image, const LevelCallback& onLevelComplete);
+    void resetBuildStats();
+    bool evaluateNode(QuadTreeNode* node, const std::vector<std::vector<RGB>>& image, int depth);  // Returns whether to subdivide
+    DepthStats& recordNode(int depth, double error, bool split, double threshold);
+    void writeNode(const QuadTreeNode* node, std::string& data) const;
+    bool readNode(QuadTreeNode* node, const std::string& data, size_t& pos, int depth, double threshold);
     int countNodesRecursive(const QuadTreeNode* node) const;
     int countLeafNodesRecursive(const QuadTreeNode* node) const;
-    void saveNodeToImage(const QuadTreeNode* node, std::vector<std::vector<RGB>>& outputImage) const;
+    void renderLeaves(std::vector<std::vector<RGB>>& outputImage, const LeafColorFunction* leafColor) const;
+    // Fills the rows (one pointer per image row) from disjoint subtrees on worker threads
+    void renderLeaves(const std::vector<RGB*>& rows, const LeafColorFunction* leafColor) const;
+    void saveNodeToImage(const QuadTreeNode* node, int depth, const std::vector<RGB*>& rows,
+                         const LeafColorFunction* leafColor) const;
+    void renderNodeRow(const QuadTreeNode* node, int y, std::vector<RGB>& row) const;
+    void collectRenderSubtrees(const QuadTreeNode* node, int depth, int splitDepth,
+                               std::vector<std::pair<const QuadTreeNode*, int>>& subtrees) const;
+
+    // Builds from precomputed block statistics with the same counters as buildFromImage
+    friend class AnnotatedTree;
 };
 
 #endif // QUADTREE_HPP
\ No newline at end of file
@@ -3,19 +3,28 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 #include "QuadTree.hpp"
 #include "ErrorMeasurement.hpp"
+#include "AnnotatedTree.hpp"
 
 class QuadTreeCompressor {
 public:
     // Constructor
     QuadTreeCompressor();
 
-    // Main compression function
+    // Builds through an AnnotatedTree of the image, kept until an image with other pixels is
+    // compressed, so compressing the same image again with any method, threshold or minimum block
+    // size reads only the blocks no earlier build reached. With a directory, the annotated tree
+    // of each image is also saved there (<pixel hash>.qta) and picked up by later processes.
+    void enableAnnotations(const std::string& directory = "");
+
+    // Main compression function; with onLevelComplete the tree is built breadth-first
     QuadTree compressImage(
         const std::vector<std::vector<RGB>>& image,
         double threshold,
-        const std::string& errorMethod = "VAR");
+        const std::string& errorMethod = "VAR",
+        const QuadTree::LevelCallback& onLevelComplete = nullptr);
 
     // Compression with target ratio
     QuadTree compressImageWithTargetRatio(
@@ -24,7 +33,19 @@ public:
         const std::string& errorMethod = "VAR",
         int maxIterations = 10);
 
+    // Threshold giving a compression ratio close to targetRatio; sets the static ProgramOptions
+    // while searching, so callers restore them afterwards. Every step counts the leaves of the
+    // same image's tree through an annotated tree, which the next compressImage call reuses;
+    // without enableAnnotations that build then releases it.
+    double adjustThresholdForTargetRatio(
+        const std::vector<std::vector<RGB>>& image,
+        double targetRatio,
+        double initialThreshold,
+        const std::string& errorMethod,
+        int minBlockSize);
+
     // Compression statistics
+    void measure(const QuadTree& tree);  // Sets them for a tree built elsewhere, e.g. read from a cache
     double getCompressionRatio() const;
     int getOriginalSize() const;
     int getCompressedSize() const;
@@ -32,6 +53,14 @@ public:
 private:
     int originalSize;
     int compressedSize;
+    bool annotate;
+    bool annotateNextBuild;  // Set by the target-ratio search for the build that follows it
+    std::string annotationDirectory;
+    std::unique_ptr<AnnotatedTree> annotations;
+
+    // The annotated tree for image, from memory, the annotation directory or new
+    AnnotatedTree& annotationsFor(const std::vector<std::vector<RGB>>& image);
+    std::string annotationFile(uint64_t imageHash) const;
 };
 
 #endif // QUADTREE_COMPRESSOR_HPP
\ No newline at end of file
@@ -0,0 +1,52 @@
+#ifndef RESULT_CACHE_HPP
+#define RESULT_CACHE_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "QuadTree.hpp"
+
+// On-disk cache of compression results for --cache-dir, so a repeated request skips the build.
+// An entry is keyed by a hash of the decoded pixels and the options that shape the tree
+// (error method, threshold, minimum block size and target ratio). It consists of <key>.tree,
+// with the serialized tree and the threshold it was built with, and one <key>.<tag> file per
+// encoded output, where the tag names the format and encoder settings (e.g. png6, jpg90).
+// Once the directory is over its size cap, whole entries are removed, least recently used
+// first; a hit refreshes the entry's modification time. Files are written under temporary
+// names and renamed, so several processes and threads can share a directory.
+class ResultCache {
+public:
+    // An empty directory disables the cache
+    ResultCache(const std::string& directory, long long maxBytes);
+
+    bool enabled() const;
+
+    // 64-bit hash of the image size and every pixel
+    static uint64_t hashPixels(const std::vector<std::vector<RGB>>& image);
+    // Entry name for an image and the options its tree is built with
+    static std::string makeKey(const std::vector<std::vector<RGB>>& image, const std::string& errorMethod,
+                               double threshold, int minBlockSize, double targetRatio);
+
+    // Reads the entry's tree into tree, which has the image's size, and the threshold it was built
+    // with. Counts a cache_hits or cache_misses stat.
+    bool loadTree(const std::string& key, QuadTree& tree, double& threshold) const;
+    void storeTree(const std::string& key, const QuadTree& tree, double threshold) const;
+
+    // Writes the entry's encoding for outputFile's format and the current encoder settings to
+    // outputFile ("-" is standard output). Counts a cache_output_hits or cache_output_misses stat.
+    bool loadOutput(const std::string& key, const std::string& outputFile, bool quantizePalette) const;
+    // Adds the file just written to outputFile to the entry; standard output is not cached
+    void storeOutput(const std::string& key, const std::string& outputFile, bool quantizePalette) const;
+
+private:
+    std::string directory;
+    long long maxBytes;
+
+    // "png6", "png6p", "jpg90", "ppm" or "pam"; empty for outputs that are not cached
+    static std::string outputTag(const std::string& outputFile, bool quantizePalette);
+    // Moves a finished temporary file into place, then evicts entries over the size cap
+    void commit(const std::string& temporaryFile, const std::string& file) const;
+    void evict() const;
+};
+
+#endif // RESULT_CACHE_HPP
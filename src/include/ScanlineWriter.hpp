@@ -0,0 +1,32 @@
+#ifndef SCANLINE_WRITER_HPP
+#define SCANLINE_WRITER_HPP
+
+#include <string>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include "QuadTree.hpp"
+
+// Image encoder that receives pixels one row at a time, top to bottom,
+// so callers never need to hold the whole output image in memory
+class ScanlineWriter {
+public:
+    virtual ~ScanlineWriter() {}
+
+    virtual bool begin(const std::string& filename, int width, int height) = 0;
+    virtual bool writeRow(const RGB* row) = 0;
+    virtual bool finish() = 0;
+
+private:
+    std::unique_ptr<std::streambuf> stdoutBuffer;
+
+protected:
+    // Opens filename for binary output; "-" is standard output
+    bool openOutput(const std::string& filename);
+    // Flushes and releases the output; false if any write failed
+    bool closeOutput();
+
+    std::unique_ptr<std::ostream> file;  // Null until openOutput succeeds
+};
+
+#endif // SCANLINE_WRITER_HPP
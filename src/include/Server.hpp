@@ -0,0 +1,36 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <string>
+#include "ResultCache.hpp"
+#include "QuadTreeCompressor.hpp"
+
+// Long-running compression daemon on a Unix domain socket, plus the matching client.
+//
+// A request is a sequence of newline-terminated lines:
+//   arg <value>       one command-line argument, with the same options as the CLI
+//   data <n>          followed by n bytes of an encoded image, used instead of --input
+//   return-data       send the output image back instead of leaving it at --output
+//   shutdown          stop the daemon once the queued requests are done
+//   end
+// The reply is "ok" or "error <message>", then "key value" lines ("output", "shm_output",
+// "width", "height", "threshold", "nodes", "leaves", "depth", "build_ms", "output_bytes", and
+// "cache" hit or miss when the daemon has a result cache),
+// an optional "data <n>" block with the output image, and "end".
+namespace Server {
+    // Serves until SIGINT, SIGTERM or a shutdown request. Compression options given on the daemon's
+    // own command line become the defaults of every request. With a metrics file, the cumulative
+    // counters and the queue depth are rewritten after every request. Requests without --gif go
+    // through the daemon's result cache, if it has one. Every request is built with compressor,
+    // so with annotations on, repeated requests for one image reuse its annotated tree.
+    // Returns the exit code.
+    int serve(const std::string& socketPath, const std::string& metricsFile, const ResultCache& cache,
+              QuadTreeCompressor& compressor);
+
+    // Sends the CLI arguments in argv (minus --client <socket>) as one request and prints the reply.
+    // Relative paths are made absolute first. --inline sends the input file's bytes and writes the
+    // returned image to --output locally; --shutdown stops the daemon.
+    int runClient(const std::string& socketPath, int argc, char* argv[]);
+}
+
+#endif // SERVER_HPP
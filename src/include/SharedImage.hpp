@@ -0,0 +1,31 @@
+#ifndef SHARED_IMAGE_HPP
+#define SHARED_IMAGE_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "QuadTree.hpp"
+
+// Raw RGB frames in POSIX shared memory, for producers that already hold decoded pixels.
+// A segment starts with a Header in native byte order, followed by height rows of
+// stride bytes each; every row holds width packed RGB triples and optional padding.
+namespace SharedImage {
+    const uint32_t MAGIC = 0x47525451;  // "QTRG" in little-endian byte order
+
+    struct Header {
+        uint32_t magic;
+        uint32_t width;
+        uint32_t height;
+        uint32_t stride;  // Bytes per row, at least 3 * width
+    };
+
+    // Copies the frame out of the segment with one memcpy per row. Names without a leading
+    // '/' get one. Throws std::runtime_error when the segment is missing or malformed.
+    std::vector<std::vector<RGB>> load(const std::string& name);
+
+    // Renders the tree into the segment, creating it or resizing it to fit (stride = 3 * width).
+    // Rows are rendered straight into the mapping by QuadTree::renderInto.
+    bool save(const QuadTree& tree, const std::string& name);
+}
+
+#endif // SHARED_IMAGE_HPP
@@ -0,0 +1,101 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <chrono>
+#include <atomic>
+#include "Trace.hpp"
+
+// Process-wide phase timings and counters for --stats-json
+namespace Stats {
+    // Accumulated time of one program phase, excluding phases nested inside it
+    struct Phase {
+        std::string name;
+        double wallMs;
+        double cpuMs;  // Process CPU time, so it includes worker threads and overlapping phases
+        long long calls;
+        long long allocations;  // Process-wide heap allocations, counted the same way as cpuMs
+        long long allocatedBytes;
+    };
+
+    // Adds the time between construction and destruction to the named phase.
+    // Phases opened inside it on the same thread are subtracted from it.
+    // Each phase is also a trace event when --trace is on.
+    class ScopedPhase {
+    public:
+        explicit ScopedPhase(const char* name);
+        ~ScopedPhase();
+
+        // Ends the phase early; phases must still end in reverse order of starting
+        void stop();
+        // Subtracts time recorded for another phase with addPhaseTime while this one ran
+        void exclude(double wallMs, double cpuMs);
+
+    private:
+        const char* name;
+        bool running;
+        ScopedPhase* parent;
+        std::chrono::steady_clock::time_point wallStart;
+        double cpuStart;
+        double nestedWallMs;
+        double nestedCpuMs;
+        long long allocationsStart;
+        long long bytesStart;
+        long long nestedAllocations;
+        long long nestedBytes;
+        Trace::Scope trace;
+    };
+
+    void addPhaseTime(const std::string& name, double wallMs, double cpuMs,
+                      long long allocations = 0, long long allocatedBytes = 0);
+    std::vector<Phase> getPhases();
+
+    // Named counters, kept in the order they were first added
+    void addCounter(const std::string& name, long long value);
+    std::vector<std::pair<std::string, long long>> getCounters();
+
+    // Process resources
+    double processCpuMs();
+    long long peakResidentKB();
+    bool allocationTrackingEnabled();  // Built with QUADTREE_ALLOCATION_STATS
+    long long allocationCount();
+    long long allocatedBytes();
+
+    // Call site whose heap allocations are counted while an AllocationScope for it is open.
+    // Declare it as a function-local static; sites with the same name are reported together.
+    class AllocationSite {
+    public:
+        explicit AllocationSite(const char* name);
+
+        const char* const name;
+        std::atomic<long long> allocations;
+        std::atomic<long long> bytes;
+    };
+
+    // Attributes allocations made on the calling thread to a site; the innermost scope wins
+    class AllocationScope {
+    public:
+        explicit AllocationScope(AllocationSite& site);
+        ~AllocationScope();
+
+    private:
+        AllocationSite* previous;
+    };
+
+    struct SiteUsage {
+        std::string name;
+        long long allocations;
+        long long bytes;
+    };
+    std::vector<SiteUsage> getAllocationSites();
+
+    // Writes the phases, counters and resource usage as one JSON object.
+    // info holds extra top-level string fields such as the input file.
+    bool writeJson(const std::string& filename,
+                   const std::vector<std::pair<std::string, std::string>>& info,
+                   double totalWallMs);
+}
+
+#endif // STATS_HPP
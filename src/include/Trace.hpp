@@ -0,0 +1,43 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <string>
+#include <utility>
+
+// Opt-in Chrome Trace Event recording for --trace; open the file in chrome://tracing or Perfetto
+namespace Trace {
+    // Starts recording; event timestamps are relative to this call
+    void enable();
+    bool isEnabled();
+
+    // Records one complete ("X") event covering the lifetime of the scope on the calling thread.
+    // Does nothing unless tracing is enabled and record is true.
+    class Scope {
+    public:
+        Scope(const char* name, const char* category, bool record = true);
+        ~Scope();
+
+        // Records the event now instead of at destruction
+        void end();
+
+        // Adds an integer argument shown with the event; up to MAX_ARGS are kept
+        Scope& arg(const char* key, long long value);
+
+        static const int MAX_ARGS = 4;
+
+    private:
+        const char* name;
+        const char* category;
+        bool active;
+        double startUs;
+        int argCount;
+        std::pair<const char*, long long> args[MAX_ARGS];
+    };
+
+    // Labels the calling thread in the trace viewer
+    void setThreadName(const std::string& name);
+
+    bool writeJson(const std::string& filename);
+}
+
+#endif // TRACE_HPP
@@ -13,17 +13,42 @@ namespace Utils {
     std::string getDirectoryPath(const std::string& filePath);
     std::string getFileNameFromPath(const std::string& filePath);
     bool createDirectory(const std::string& path);
+    // Unique name next to file for writing it and renaming it into place
+    std::string temporaryPath(const std::string& file);
 
     // Program options structure
     struct ProgramOptions {
         std::string inputFile;
         std::string outputFile;
         std::string gifFile;
+        std::string statsFile;
+        std::string traceFile;
+        std::string costMapFile;
+        std::string metricsFile;
+        std::string shmInput;      // POSIX shared-memory segment with a raw RGB frame, instead of inputFile
+        std::string shmOutput;     // Segment the rendered frame is written to
+        std::string batchFile;     // --batch: list of inputs, one per line ("-" reads the list from stdin)
+        std::string outputDir;     // Where batch outputs go; next to each input by default
+        std::string serveSocket;   // --serve: run as a daemon on this Unix socket
+        std::string clientSocket;  // --client: send this run to the daemon on this socket
+        std::string cacheDir;      // --cache-dir: on-disk result cache, off when empty
+        std::string annotationDir; // --annotation-dir: where annotated trees are kept between runs
         static std::string errorMethod;
         static double threshold;
         static int minBlockSize;
         static double targetCompressionRatio;
+        static int pngCompressionLevel;
+        static int jpegQuality;
+        static std::string outputFormat;  // Encoder for "--output -": png, jpg, ppm or pam
+        static int threads;  // Worker threads for rendering and encoding, 0 = all hardware threads
+        static int traceMinBlock;  // Smallest subtree side recorded by --trace
+        static bool verbose;  // Per-depth build report; also times each depth of the build
+        int jobs = 0;                  // Concurrent batch images, 0 = all hardware threads
+        long long memoryBudgetMB = 0;  // Estimated memory of running batch images, 0 = half of RAM
+        long long cacheSizeMB = 1024;  // Result cache size before least recently used entries are evicted
         bool generateGif = false;
+        bool quantizePalette = false;
+        bool annotate = false;  // Build through an annotated tree that later builds of the same image reuse
     };
 
     ProgramOptions parseCommandLineArgs(int argc, char* argv[]);
@@ -32,6 +57,10 @@ namespace Utils {
     RGB hexToRGB(const std::string& hexColor);
     std::string RGBToHex(const RGB& color);
 
+    // Text utilities
+    // Contents of a JSON string literal: quotes, backslashes and control characters escaped
+    std::string escapeJson(const std::string& value);
+
     // Math utilities
     int clamp(int value, int min, int max);
 
@@ -6,12 +6,21 @@
 #include <cstdint>
 #include <cmath>
 #include <fstream>
+#include <future>
 
 #include "QuadTree.hpp"
 #include "ImageProcessor.hpp"
 #include "QuadTreeCompressor.hpp"
 #include "Utils.hpp"
 #include "GifGenerator.hpp"
+#include "Stats.hpp"
+#include "Trace.hpp"
+#include "CostMap.hpp"
+#include "Metrics.hpp"
+#include "Server.hpp"
+#include "SharedImage.hpp"
+#include "Batch.hpp"
+#include "ResultCache.hpp"
 
 // Helper function to display program usage
 void showUsage(const char* programName) {
@@ -19,92 +28,88 @@ void showUsage(const char* programName) {
     std::cout << "==========================\n\n";
     std::cout << "Usage: " << programName << " [options]\n\n";
     std::cout << "Options:\n";
-    std::cout << "  --input <file>          : Input image file path\n";
+    std::cout << "  --input <file>          : Input image file path; - reads standard input\n";
     std::cout << "  --error-method <method> : Error measurement method (VAR, MAD, MPD, ENT, SSIM)\n";
     std::cout << "  --threshold <value>     : Error threshold value\n";
     std::cout << "  --min-block <size>      : Minimum block size\n";
     std::cout << "  --target-ratio <ratio>  : Target compression ratio (0.0-1.0, 0 to disable)\n";
-    std::cout << "  --output <file>         : Output compressed image file path\n";
+    std::cout << "  --output <file>         : Output compressed image file path (png, jpg, ppm or pam)\n";
+    std::cout << "  --output-format <fmt>   : Format written for --output - (png, jpg, ppm, pam; default png)\n";
     std::cout << "  --gif <file>            : Output GIF animation file path (optional)\n";
+    std::cout << "  --shm-input <name>      : Read a raw RGB frame from POSIX shared memory instead of --input\n";
+    std::cout << "  --shm-output <name>     : Write the compressed frame to POSIX shared memory (with or without --output)\n";
+    std::cout << "  --palette               : Quantize PNG output to a 256-color palette\n";
+    std::cout << "  --png-level <1-9>       : PNG compression level, 1 = fastest, 9 = smallest (default 6)\n";
+    std::cout << "  --jpeg-quality <1-100>  : JPEG quality (default 90)\n";
+    std::cout << "  --threads <n>           : Worker threads for rendering and encoding (default: all cores)\n";
+    std::cout << "  --stats-json <file>     : Write per-phase timings and counters as JSON\n";
+    std::cout << "  --cost-map <file>       : Write heatmaps of build cost per leaf and of leaf error (<file>_error)\n";
+    std::cout << "  --metrics <file>        : Add this run to a Prometheus textfile-collector file (*.prom)\n";
+    std::cout << "  --trace <file>          : Write a Chrome trace of the build, encode and GIF phases\n";
+    std::cout << "  --trace-min-block <n>   : Smallest subtree side recorded in the trace (default 64)\n";
+    std::cout << "  --verbose               : Print per-depth build statistics and error histograms\n";
+    std::cout << "  --cache-dir <dir>       : Reuse trees and encoded outputs of earlier runs with the same pixels\n";
+    std::cout << "                            and options (not with --gif)\n";
+    std::cout << "  --cache-size <MB>       : Result cache size before the least recently used entries go (default 1024)\n";
+    std::cout << "  --annotate              : Keep per-block averages and errors so later builds of the same image\n";
+    std::cout << "                            with any method or threshold skip those blocks (useful with --serve)\n";
+    std::cout << "  --annotation-dir <dir>  : Like --annotate, and keep the annotated trees in <dir> between runs\n";
+    std::cout << "  --batch <list>          : Compress every image listed in a file (one path per line, - for stdin)\n";
+    std::cout << "  --output-dir <dir>      : Directory for batch outputs (default: next to each input)\n";
+    std::cout << "  --jobs <n>              : Images compressed at once in batch mode (default: all cores)\n";
+    std::cout << "  --memory-budget <MB>    : Estimated memory allowed for running batch images (default: half of RAM)\n";
+    std::cout << "  --serve <socket>        : Run as a daemon on a Unix socket; the other options become defaults\n";
+    std::cout << "  --client <socket>       : Send this run to a daemon (add --inline to send the image bytes,\n";
+    std::cout << "                            or --shutdown to stop the daemon)\n";
     std::cout << "  --help                  : Display this help message\n\n";
     std::cout << "Example:\n";
     std::cout << "  " << programName << " --input image.jpg --error-method VAR --threshold 10.0 --min-block 4 --output output.jpg\n";
 }
 
-// calculate maximum depth of the quadtree
-int calculateTreeDepth(const QuadTreeNode* node, int currentDepth = 0) {
-    if (!node) return currentDepth - 1;
-
-    if (node->isNodeLeaf()) {
-        return currentDepth;
+// Print the per-depth counters collected while the tree was built
+void printDepthStats(const QuadTree& tree) {
+    std::cout << "\n=== Build Statistics per Depth ===\n";
+    std::cout << std::setw(5) << "depth" << std::setw(10) << "nodes" << std::setw(10) << "leaves"
+              << std::setw(14) << "pixels" << std::setw(10) << "ms" << std::setw(16) << "mean err"
+              << std::setw(16) << "max err" << "\n";
+
+    const std::vector<QuadTree::DepthStats>& depths = tree.getDepthStats();
+    for (size_t depth = 0; depth < depths.size(); ++depth) {
+        const QuadTree::DepthStats& stats = depths[depth];
+        std::cout << std::setw(5) << depth << std::setw(10) << stats.nodes << std::setw(10) << stats.leaves
+                  << std::setw(14) << stats.pixelsScanned << std::fixed << std::setprecision(2)
+                  << std::setw(10) << stats.milliseconds
+                  << std::setw(16) << (stats.nodes ? stats.errorSum / stats.nodes : 0.0)
+                  << std::setw(16) << stats.errorMax << "\n";
     }
 
-    int maxDepth = currentDepth;
-    for (int i = 0; i < 4; ++i) {
-        int childDepth = calculateTreeDepth(node->getChildAt(i), currentDepth + 1);
-        maxDepth = std::max(maxDepth, childDepth);
+    // Error distribution in multiples of the threshold; nodes at or below 1x were not split
+    std::cout << "\nError histogram (x threshold):\n";
+    std::cout << std::setw(5) << "depth";
+    const char* const binLabels[QuadTree::ERROR_BINS] = {"<=1/8", "<=1/4", "<=1/2", "<=1", "<=2", "<=4", "<=8", ">8"};
+    for (const char* label : binLabels) {
+        std::cout << std::setw(9) << label;
     }
-
-    return maxDepth;
-}
-
-// Function to adjust threshold to achieve target compression ratio (not finished)
-double adjustThresholdForTargetRatio(
-    const std::vector<std::vector<RGB>>& image,
-    double targetRatio,
-    double initialThreshold,
-    const std::string& errorMethod,
-    int minBlockSize) {
-
-    // Initial threshold guesses
-    double lowThreshold = 0.1;
-    double highThreshold = 1000.0;
-    double currentThreshold = initialThreshold;
-    double bestThreshold = currentThreshold;
-    double bestRatioDifference = 1.0; // Start with a large difference
-
-    // Binary search for the threshold that gives closest to the target ratio
-    const int MAX_ITERATIONS = 15; // Usually converges in <15 iterations
-
-    for (int i = 0; i < MAX_ITERATIONS; i++) {
-        // Set the current threshold for compression
-        Utils::ProgramOptions::threshold = currentThreshold;
-        Utils::ProgramOptions::minBlockSize = minBlockSize;
-        Utils::ProgramOptions::errorMethod = errorMethod;
-
-        // Test compression with current threshold
-        QuadTreeCompressor compressor;
-        QuadTree tree = compressor.compressImage(image, currentThreshold, errorMethod);
-
-        // Calculate actual compression ratio
-        double actualRatio = compressor.getCompressionRatio();
-        double ratioDifference = std::fabs(actualRatio - targetRatio);
-
-        // Store the best threshold found so far
-        if (ratioDifference < bestRatioDifference) {
-            bestRatioDifference = ratioDifference;
-            bestThreshold = currentThreshold;
-
-            // If we're very close to the target, we can stop
-            if (ratioDifference < 0.005) { // Within 0.5%
-                break;
-            }
-        }
-
-        // Binary search adjustment
-        if (actualRatio < targetRatio) {
-            highThreshold = currentThreshold;
-            currentThreshold = (lowThreshold + currentThreshold) / 2;
-        } else {
-            lowThreshold = currentThreshold;
-            currentThreshold = (highThreshold + currentThreshold) / 2;
+    std::cout << "\n";
+    for (size_t depth = 0; depth < depths.size(); ++depth) {
+        std::cout << std::setw(5) << depth;
+        for (int bin = 0; bin < QuadTree::ERROR_BINS; ++bin) {
+            std::cout << std::setw(9) << depths[depth].errorHistogram[bin];
         }
+        std::cout << "\n";
     }
+}
 
-    return bestThreshold;
+// Add this run's counters to the --metrics file, if one was requested
+void updateMetricsFile(const std::string& metricsFile) {
+    if (metricsFile.empty()) return;
+    if (!Metrics::mergeIntoTextfile(metricsFile)) {
+        std::cerr << "Error: Failed to write metrics to: " << metricsFile << "\n";
+    }
 }
 
 int main(int argc, char* argv[]) {
+    std::string metricsFile;
     try {
         // If no arguments provided or help requested, show usage
         if (argc == 1 || (argc == 2 && (std::string(argv[1]) == "--help" || std::string(argv[1]) == "-h"))) {
@@ -114,14 +119,42 @@ int main(int argc, char* argv[]) {
 
         // Parse command line arguments
         Utils::ProgramOptions options = Utils::parseCommandLineArgs(argc, argv);
+        metricsFile = options.metricsFile;
+
+        if (!options.serveSocket.empty()) {
+            ResultCache cache(options.cacheDir, options.cacheSizeMB * 1024 * 1024);
+            QuadTreeCompressor compressor;
+            if (options.annotate) compressor.enableAnnotations(options.annotationDir);
+            return Server::serve(options.serveSocket, options.metricsFile, cache, compressor);
+        }
+        if (!options.clientSocket.empty()) {
+            return Server::runClient(options.clientSocket, argc, argv);
+        }
+        if (!options.batchFile.empty()) {
+            return Batch::run(options);
+        }
 
         // Validate inputs
-        if (options.inputFile.empty()) {
-            std::cerr << "Error: Input file path is required. Use --input <file>\n";
+        if (options.inputFile.empty() && options.shmInput.empty()) {
+            std::cerr << "Error: Input file path is required. Use --input <file> or --shm-input <name>\n";
             return 1;
         }
 
-        if (options.outputFile.empty()) {
+        // Piped input is written back to standard output unless an output is given
+        if (options.inputFile == "-" && options.outputFile.empty() && options.shmOutput.empty()) {
+            options.outputFile = "-";
+        }
+
+        // Progress messages go to stderr while the image is streamed to stdout
+        if (options.outputFile == "-") {
+            std::cout.rdbuf(std::cerr.rdbuf());
+        }
+
+        if (options.outputFile.empty() && options.shmOutput.empty()) {
+            if (options.inputFile.empty()) {
+                std::cerr << "Error: Output is required with --shm-input. Use --output <file> or --shm-output <name>\n";
+                return 1;
+            }
             // Generate output filename based on input if not provided
             std::string ext = Utils::getFileExtension(options.inputFile);
             options.outputFile = options.inputFile.substr(0, options.inputFile.length() - ext.length() - 1)
@@ -129,34 +162,55 @@ int main(int argc, char* argv[]) {
             std::cout << "Output file not specified. Using: " << options.outputFile << std::endl;
         }
 
-        if (!Utils::fileExists(options.inputFile)) {
+        if (!options.inputFile.empty() && options.inputFile != "-" && !Utils::fileExists(options.inputFile)) {
             std::cerr << "Error: Input file does not exist: " << options.inputFile << "\n";
             return 1;
         }
 
         std::cout << "=== QuadTree Image Compression ===\n\n";
-        std::cout << "Input file: " << options.inputFile << "\n";
+        if (options.inputFile.empty()) {
+            std::cout << "Input shared memory: " << options.shmInput << "\n";
+        } else {
+            std::cout << "Input file: " << options.inputFile << "\n";
+        }
         std::cout << "Error method: " << options.errorMethod << "\n";
         std::cout << "Threshold: " << options.threshold << "\n";
         std::cout << "Min block size: " << options.minBlockSize << "\n";
         if (options.targetCompressionRatio > 0) {
             std::cout << "Target compression ratio: " << options.targetCompressionRatio * 100 << "%\n";
         }
-        std::cout << "Output file: " << options.outputFile << "\n";
+        if (!options.outputFile.empty()) {
+            std::cout << "Output file: " << options.outputFile << "\n";
+        }
+        if (!options.shmOutput.empty()) {
+            std::cout << "Output shared memory: " << options.shmOutput << "\n";
+        }
         if (!options.gifFile.empty()) {
             std::cout << "GIF output file: " << options.gifFile << "\n";
         }
         std::cout << "\n";
 
+        if (!options.traceFile.empty()) {
+            Trace::enable();
+            Trace::setThreadName("main");
+        }
+
         // Start timing
         auto startTime = std::chrono::high_resolution_clock::now();
 
         // Load the image
         std::cout << "Loading image...\n";
-        std::vector<std::vector<RGB>> image = ImageProcessor::loadImage(options.inputFile);
+        std::vector<std::vector<RGB>> image;
+        {
+            Stats::ScopedPhase phase("decode");
+            image = options.inputFile.empty() ? SharedImage::load(options.shmInput)
+                                              : ImageProcessor::loadImage(options.inputFile);
+        }
 
         if (image.empty() || image[0].empty()) {
             std::cerr << "Error: Failed to load image or image is empty.\n";
+            Metrics::recordError("decode");
+            updateMetricsFile(metricsFile);
             return 1;
         }
 
@@ -170,10 +224,34 @@ int main(int argc, char* argv[]) {
         Utils::ProgramOptions::threshold = options.threshold;
         Utils::ProgramOptions::minBlockSize = options.minBlockSize;
 
+        // GIF frames are written while the tree is built, so those runs always build
+        ResultCache cache(options.gifFile.empty() ? options.cacheDir : "", options.cacheSizeMB * 1024 * 1024);
+        std::string cacheKey;
+        QuadTree tree(imageWidth, imageHeight);
+        bool cacheHit = false;
+        if (cache.enabled()) {
+            Stats::ScopedPhase phase("cache_lookup");
+            cacheKey = ResultCache::makeKey(image, options.errorMethod, options.threshold, options.minBlockSize,
+                                            options.targetCompressionRatio);
+            double cachedThreshold = 0;
+            cacheHit = cache.loadTree(cacheKey, tree, cachedThreshold);
+            if (cacheHit) {
+                std::cout << "Result cache hit: " << cacheKey << " (threshold " << cachedThreshold << ")\n";
+                Utils::ProgramOptions::threshold = cachedThreshold;
+            }
+        }
+
+        // Create compressor
+        QuadTreeCompressor compressor;
+        if (options.annotate) {
+            compressor.enableAnnotations(options.annotationDir);
+        }
+
         // Adjust threshold if target compression ratio is specified
-        if (options.targetCompressionRatio > 0) {
+        if (!cacheHit && options.targetCompressionRatio > 0) {
             std::cout << "Adjusting threshold to achieve target compression ratio...\n";
-            double adjustedThreshold = adjustThresholdForTargetRatio(
+            Stats::ScopedPhase phase("target_ratio_search");
+            double adjustedThreshold = compressor.adjustThresholdForTargetRatio(
                 image,
                 options.targetCompressionRatio,
                 options.threshold,
@@ -185,62 +263,121 @@ int main(int argc, char* argv[]) {
             Utils::ProgramOptions::threshold = adjustedThreshold;
         }
 
-        // Create compressor
-        QuadTreeCompressor compressor;
+        // Each completed level of the tree is queued for the GIF writer's thread, which encodes
+        // its frame while the build goes on with the next level
+        GifGenerator::AnimationWriter gifWriter;
+        bool gifWritten = false;
+        QuadTree::LevelCallback onLevelComplete;
+        if (!options.gifFile.empty()) {
+            gifWritten = gifWriter.begin(options.gifFile, imageWidth, imageHeight);
+            if (gifWritten) {
+                Stats::ScopedPhase palettePhase("gif");
+                gifWriter.fixPalette(image);
+                palettePhase.stop();
+                onLevelComplete = [&gifWriter, &gifWritten](int, const std::vector<QuadTreeNode*>& nodes) {
+                    Stats::ScopedPhase phase("gif");
+                    gifWritten = gifWriter.writeLevel(nodes) && gifWritten;
+                };
+            }
+        }
 
         // Compress the image
-        std::cout << "Compressing image...\n";
-        QuadTree tree = compressor.compressImage(image, Utils::ProgramOptions::threshold, options.errorMethod);
+        if (cacheHit) {
+            compressor.measure(tree);
+        } else {
+            std::cout << "Compressing image...\n";
+            Stats::ScopedPhase buildPhase("build");
+            tree = compressor.compressImage(image, Utils::ProgramOptions::threshold, options.errorMethod, onLevelComplete);
+            buildPhase.stop();
+
+            Stats::addCounter("nodes_evaluated", tree.getNodesEvaluated());
+            Stats::addCounter("pixels_scanned_" + options.errorMethod, tree.getPixelsScanned());
+            cache.storeTree(cacheKey, tree, Utils::ProgramOptions::threshold);
+        }
 
         // Calculate compression statistics
         double compressionRatio = compressor.getCompressionRatio() * 100.0;
         int originalSize = compressor.getOriginalSize();
         int compressedSize = compressor.getCompressedSize();
 
-        // Generate the output image
-        std::cout << "Generating output image...\n";
-        std::vector<std::vector<RGB>> outputImage;
-        tree.saveToImage(outputImage);
+        // The output image is streamed straight from the tree, one scanline at a time
+        std::cout << "Output image dimensions: " << tree.getRoot()->getBlockWidth() << " x "
+                  << tree.getRoot()->getBlockHeight() << std::endl;
 
-        // Check output image dimensions
-        if (!outputImage.empty()) {
-            std::cout << "Output image dimensions: " << outputImage[0].size() << " x " << outputImage.size() << std::endl;
-        } else {
-            std::cerr << "Error: Output image is empty\n";
-            return 1;
+        // The GIF writer's thread may still be encoding level frames. Waiting for it and encoding
+        // the final frame, which only reads the tree, both happen on another thread while the
+        // output image is written, so the whole GIF overlaps with saving
+        std::future<bool> gifResult;
+        if (!options.gifFile.empty()) {
+            std::cout << "Finishing GIF animation in the background...\n";
+            gifResult = std::async(std::launch::async, [&gifWriter, &gifWritten, &tree]() {
+                Trace::setThreadName("gif");
+                Stats::ScopedPhase phase("gif");
+                return gifWriter.finish(tree) && gifWritten;
+            });
         }
 
         // Save the output image
-        std::cout << "Saving image to: " << options.outputFile << "...\n";
-        bool saved = ImageProcessor::saveImage(outputImage, options.outputFile);
-        if (!saved) {
-            std::cerr << "Error: Failed to save output image.\n";
-
-            std::string fileName = options.outputFile.substr(options.outputFile.find_last_of('/') + 1);
-            std::cout << "Trying to save to current directory instead: " << fileName << std::endl;
-
-            saved = ImageProcessor::saveImage(outputImage, fileName);
+        if (!options.outputFile.empty()) {
+            std::cout << "Saving image to: " << options.outputFile << "...\n";
+            bool saved = cacheHit && cache.loadOutput(cacheKey, options.outputFile, options.quantizePalette);
             if (saved) {
-                options.outputFile = fileName;
-                std::cout << "Image saved to current directory successfully.\n";
+                std::cout << "Encoded output copied from the result cache\n";
             } else {
-                std::cerr << "Error: Failed to save image to current directory as well.\n";
+                saved = ImageProcessor::saveImage(tree, options.outputFile, options.quantizePalette);
+                if (saved) {
+                    cache.storeOutput(cacheKey, options.outputFile, options.quantizePalette);
+                }
+            }
+            if (!saved) {
+                std::cerr << "Error: Failed to save output image.\n";
+
+                std::string fileName = options.outputFile.substr(options.outputFile.find_last_of('/') + 1);
+                std::cout << "Trying to save to current directory instead: " << fileName << std::endl;
+
+                saved = ImageProcessor::saveImage(tree, fileName, options.quantizePalette);
+                if (saved) {
+                    options.outputFile = fileName;
+                    std::cout << "Image saved to current directory successfully.\n";
+                } else {
+                    std::cerr << "Error: Failed to save image to current directory as well.\n";
+                    Metrics::recordError("save");
+                    updateMetricsFile(metricsFile);
+                    return 1;
+                }
+            }
+        }
+
+        if (!options.shmOutput.empty()) {
+            std::cout << "Writing frame to shared memory: " << options.shmOutput << "...\n";
+            if (!SharedImage::save(tree, options.shmOutput)) {
+                Metrics::recordError("save");
+                updateMetricsFile(metricsFile);
                 return 1;
             }
         }
 
-        // Generate GIF animation
-        if (!options.gifFile.empty()) {
-            std::cout << "Generating GIF animation...\n";
-            if (GifGenerator::generateCompressionGif(image, tree, options.gifFile)) {
+        if (!options.costMapFile.empty()) {
+            std::cout << "Saving cost map to: " << options.costMapFile << "...\n";
+            if (!CostMap::save(tree, Utils::ProgramOptions::threshold, options.costMapFile)) {
+                std::cerr << "Error: Failed to save cost map.\n";
+            }
+        }
+
+        // Wait for the GIF animation
+        if (gifResult.valid()) {
+            if (gifResult.get()) {
                 std::cout << "GIF animation saved to: " << options.gifFile << "\n";
             } else {
                 std::cerr << "Error: Failed to generate GIF animation.\n";
+                Metrics::recordError("gif");
             }
         }
 
-        // Calculate tree depth
-        int treeDepth = calculateTreeDepth(tree.getRoot());
+        // Tree shape comes from the counters kept during the build
+        int treeDepth = tree.getDepth();
+        long long totalNodes = tree.getNodeCount();
+        long long leafNodes = tree.getLeafCount();
 
         // End timing
         auto endTime = std::chrono::high_resolution_clock::now();
@@ -267,6 +404,11 @@ int main(int argc, char* argv[]) {
             outputFile.close();
         }
 
+        // Shared-memory frames are raw RGB
+        long rawFrameSize = static_cast<long>(imageWidth) * imageHeight * 3;
+        if (options.inputFile.empty()) actualOriginalSize = rawFrameSize;
+        if (options.outputFile.empty()) actualCompressedSize = rawFrameSize;
+
         // Display both theoretical and actual sizes
         std::cout << "Theoretical original image size: " << originalSize << " bytes\n";
         std::cout << "Theoretical compressed image size: " << compressedSize << " bytes\n";
@@ -289,16 +431,67 @@ int main(int argc, char* argv[]) {
             }
         }
         std::cout << "Tree depth: " << treeDepth << "\n";
-        std::cout << "Total nodes: " << tree.countNodes() << "\n";
-        std::cout << "Leaf nodes: " << tree.countLeafNodes() << "\n";
-        std::cout << "Output image saved to: " << options.outputFile << "\n";
+        std::cout << "Total nodes: " << totalNodes << "\n";
+        std::cout << "Leaf nodes: " << leafNodes << "\n";
+        if (!options.outputFile.empty()) {
+            std::cout << "Output image saved to: " << options.outputFile << "\n";
+        }
+        if (!options.shmOutput.empty()) {
+            std::cout << "Output frame written to shared memory: " << options.shmOutput << "\n";
+        }
         if (!options.gifFile.empty()) {
             std::cout << "GIF animation saved to: " << options.gifFile << "\n";
         }
+        if (options.verbose) {
+            printDepthStats(tree);
+        }
+
+        if (!options.statsFile.empty()) {
+            Stats::addCounter("image_width", imageWidth);
+            Stats::addCounter("image_height", imageHeight);
+            Stats::addCounter("tree_depth", treeDepth);
+            Stats::addCounter("tree_nodes", totalNodes);
+            Stats::addCounter("leaf_nodes", leafNodes);
+            Stats::addCounter("output_bytes", actualCompressedSize);
+
+            std::vector<std::pair<std::string, std::string>> info = {
+                {"input", options.inputFile.empty() ? "shm:" + options.shmInput : options.inputFile},
+                {"output", options.outputFile},
+                {"error_method", options.errorMethod},
+                {"threshold", std::to_string(Utils::ProgramOptions::threshold)},
+                {"min_block", std::to_string(options.minBlockSize)}
+            };
+            double totalWallMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+            if (Stats::writeJson(options.statsFile, info, totalWallMs)) {
+                std::cout << "Statistics written to: " << options.statsFile << "\n";
+            } else {
+                std::cerr << "Error: Failed to write statistics to: " << options.statsFile << "\n";
+            }
+        }
+
+        if (!metricsFile.empty()) {
+            // Exclusive build time, without the GIF frames written during a breadth-first build
+            double buildMs = 0;
+            for (const Stats::Phase& phase : Stats::getPhases()) {
+                if (phase.name == "build") buildMs = phase.wallMs;
+            }
+            Metrics::recordImage(options.errorMethod, actualOriginalSize, actualCompressedSize, buildMs / 1000.0);
+            updateMetricsFile(metricsFile);
+        }
+
+        if (!options.traceFile.empty()) {
+            if (Trace::writeJson(options.traceFile)) {
+                std::cout << "Trace written to: " << options.traceFile << "\n";
+            } else {
+                std::cerr << "Error: Failed to write trace to: " << options.traceFile << "\n";
+            }
+        }
 
         return 0;
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
+        Metrics::recordError("exception");
+        updateMetricsFile(metricsFile);
         return 1;
     }
 }
\ No newline at end of file
@@ -0,0 +1,123 @@
+// Consistency checks for the tree builds, their counters and the result cache serialization, run with ctest
+
+#include "AnnotatedTree.hpp"
+#include "QuadTree.hpp"
+#include "Utils.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const std::string& what) {
+        if (!condition) {
+            std::cerr << "FAILED: " << what << "\n";
+            ++failures;
+        }
+    }
+
+    bool sameColor(const RGB& a, const RGB& b) {
+        return a.r == b.r && a.g == b.g && a.b == b.b;
+    }
+
+    // Every pixel rendered by saveToImage, renderRow and renderInto equals the source pixel
+    bool rendersImage(const QuadTree& tree, const std::vector<std::vector<RGB>>& image) {
+        std::vector<std::vector<RGB>> output;
+        tree.saveToImage(output);
+        size_t stride = 3 * image[0].size() + 5;  // Padded rows, as a shared-memory frame may have
+        std::vector<uint8_t> buffer(stride * image.size());
+        tree.renderInto(buffer.data(), stride);
+        std::vector<RGB> row;
+        for (size_t y = 0; y < image.size(); ++y) {
+            tree.renderRow(static_cast<int>(y), row);
+            const RGB* strided = reinterpret_cast<const RGB*>(buffer.data() + y * stride);
+            for (size_t x = 0; x < image[y].size(); ++x) {
+                if (!sameColor(output[y][x], image[y][x]) || !sameColor(row[x], image[y][x]) ||
+                    !sameColor(strided[x], image[y][x])) return false;
+            }
+        }
+        return true;
+    }
+
+    // Builds the image, writes the tree as the result cache does, reads it into a fresh tree and
+    // checks that both render the image and agree on the leaf count
+    void checkRoundTrip(const std::string& name, const std::vector<std::vector<RGB>>& image, int expectedLeaves) {
+        int width = static_cast<int>(image[0].size());
+        int height = static_cast<int>(image.size());
+
+        QuadTree built(width, height);
+        built.buildFromImage(image, Utils::ProgramOptions::threshold);
+        check(built.getLeafCount() == expectedLeaves, name + ": leaf count of the build");
+        check(built.countLeafNodes() == expectedLeaves, name + ": leaves in the built tree");
+        check(rendersImage(built, image), name + ": build renders the image");
+
+        std::stringstream data;
+        built.write(data);
+        QuadTree loaded(width, height);
+        check(loaded.read(data, Utils::ProgramOptions::threshold), name + ": read back");
+        check(loaded.getLeafCount() == expectedLeaves, name + ": leaf count after reading");
+        check(loaded.countLeafNodes() == expectedLeaves, name + ": leaves in the read tree");
+        check(rendersImage(loaded, image), name + ": read tree renders the image");
+
+        // A rebuild of the same tree starts from a single leaf again
+        built.buildFromImage(image, Utils::ProgramOptions::threshold);
+        check(built.countLeafNodes() == expectedLeaves, name + ": leaves after rebuilding");
+        check(rendersImage(built, image), name + ": rebuild renders the image");
+    }
+
+    // The per-depth counters of the breadth-first and annotated builds match the tree they render
+    void checkBuildCounters(const std::string& name, const std::vector<std::vector<RGB>>& image, int expectedLeaves) {
+        int width = static_cast<int>(image[0].size());
+        int height = static_cast<int>(image.size());
+
+        QuadTree levels(width, height);
+        levels.buildFromImage(image, QuadTree::LevelCallback());
+        check(levels.getLeafCount() == expectedLeaves, name + ": leaf count of the breadth-first build");
+        check(levels.countLeafNodes() == expectedLeaves, name + ": leaves in the breadth-first tree");
+        check(rendersImage(levels, image), name + ": breadth-first build renders the image");
+
+        AnnotatedTree annotated(width, height, 0);
+        QuadTree reused(width, height);
+        for (int pass = 0; pass < 2; ++pass) {
+            annotated.build(reused, image, Utils::ProgramOptions::errorMethod, Utils::ProgramOptions::threshold,
+                            Utils::ProgramOptions::minBlockSize);
+            check(reused.getLeafCount() == expectedLeaves, name + ": leaf count of the annotated build");
+            check(reused.countLeafNodes() == expectedLeaves, name + ": leaves in the annotated tree");
+            check(rendersImage(reused, image), name + ": annotated build renders the image");
+        }
+    }
+}
+
+int main() {
+    Utils::ProgramOptions::errorMethod = "VAR";
+    Utils::ProgramOptions::threshold = 10;
+    Utils::ProgramOptions::minBlockSize = 4;
+
+    const RGB orange = {200, 100, 50};
+    const RGB blue = {20, 40, 220};
+
+    // The root is never split
+    std::vector<std::vector<RGB>> flat(64, std::vector<RGB>(64, orange));
+    checkRoundTrip("flat 64x64", flat, 1);
+    checkBuildCounters("flat 64x64", flat, 1);
+
+    // Split once into four flat quadrants
+    std::vector<std::vector<RGB>> halves = flat;
+    for (auto& row : halves) {
+        for (size_t x = 32; x < row.size(); ++x) {
+            row[x] = blue;
+        }
+    }
+    checkRoundTrip("two halves 64x64", halves, 4);
+    checkBuildCounters("two halves 64x64", halves, 4);
+
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+    std::cout << "All checks passed\n";
+    return 0;
+}